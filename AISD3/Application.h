@@ -1,121 +1,526 @@
-#ifndef APPLICATION_H
+﻿#ifndef APPLICATION_H
 #define APPLICATION_H
 
 #include "BinaryTree.h"
 #include "RedBlackTree.h"
+#include "MappedFile.h"
+#include "OutputBuffer.h"
+#include <chrono>
 #include <iostream>
 #include <limits>
 #include <fstream>
+#include <memory>
+#include <sstream>
 
 typedef double number;
 
 class Application {
 public:
-    Application();
+    explicit Application(const std::string& pathToBracketTree = "bracketTree.txt");
     ~Application();
 
     void exec(BinaryTree<number>& binaryTree, RedBlackTree<number>& redBlackTree);
+    // Пакетный режим без меню: выполняет сценарий и возвращает код завершения программы
+    int runBatch(std::istream& script, BinaryTree<number>& binaryTree, RedBlackTree<number>& redBlackTree);
 
 private:
-    std::string pathToBracketTree = "C:\\LETI\\AISD\\AISD3\\AISD3\\AISD3\\bracketTree.txt";
-    bool isValidTree(const std::string& str) const;
+    enum class Traversal { PreOrder, InOrder, PostOrder, BreadthFirst };
+
+    // Что и куда выводить из дерева: разобранная строка параметров
+    struct TreeView {
+        RenderOptions options;
+        std::string file;
+        bool hasFrom = false;
+        number from = 0;
+    };
+
+    std::string pathToBracketTree;
+    void printParseError(const ParseResult& result, std::ostream& out = std::cout) const;
+    void printFormatError(FormatError error, std::ostream& out = std::cout) const;
+    void printTreeViolation(TreeViolation violation, std::ostream& out = std::cout) const;
+    void printTreeStats(const TreeStatsSnapshot& stats, std::ostream& out = std::cout) const;
+    // false, если файл не удалось открыть
+    bool readBracketFile(const std::string& path, BinaryTree<number>& binaryTree, ParseResult& result) const;
+    // Значения идут из обхода прямо в буфер, без промежуточного вектора
+    void writeTraversal(Traversal order, const RedBlackTree<number>& redBlackTree, OutputBuffer& out) const;
+    void printTraversal(const char* title, Traversal order, const RedBlackTree<number>& redBlackTree) const;
+    // false и сообщение в errors, если параметр не распознан
+    bool parseTreeView(const std::string& text, TreeView& view, std::ostream& errors) const;
+    // render(out) выводит дерево и возвращает false, если выбранного поддерева нет
+    template <typename Render>
+    bool writeTreeView(const TreeView& view, OutputBuffer& out, std::ostream& errors, Render render) const;
 };
 
-Application::Application() {}
+Application::Application(const std::string& pathToBracketTree) : pathToBracketTree(pathToBracketTree) {}
 
 Application::~Application() {}
 
 // (8 (9 (5)) (1))
 // (8 (3 (1) (6 (4) (7))) (10 (14 (13))))
 // (9 (6 (3 (1 (2)) (4 (5))) (8 (7))) (17 (16 (12 (11 (10)) (14 (13) (15)))) (20 (19 (18)) (21))))
-bool Application::isValidTree(const std::string& str) const
+void Application::printParseError(const ParseResult& result, std::ostream& out) const
 {
-    std::stack<int> countInLevels;
-    int unclosedBrackets = 0;
-    bool isPrevUnclosedBracket = false;
-
-    for (size_t i = 0; i < str.size(); i++) {
-        char ch = str[i];
-        if (std::isspace(ch)) {
-            continue;
+    switch (result.error) {
+    case ParseError::None:
+        return;
+    case ParseError::DoubleOpenBracket:
+        out << "Ошибка: Две откр. скобки подряд";
+        break;
+    case ParseError::UnexpectedCloseBracket:
+        out << "Ошибка: Лишняя закрывающая скобка";
+        break;
+    case ParseError::EmptyBrackets:
+        out << "Ошибка: В скобках не содержится узел";
+        break;
+    case ParseError::TooManyChildren:
+        out << "Ошибка: У узла более 2 потомков";
+        break;
+    case ParseError::NumberOutsideBrackets:
+        out << "Ошибка: Число вне скобок";
+        break;
+    case ParseError::InvalidCharacter:
+        out << "Ошибка: некорректный символ '" << result.symbol << "'";
+        break;
+    case ParseError::InvalidNumber:
+        out << "Ошибка: некорректное число";
+        break;
+    case ParseError::MultipleRoots:
+        out << "Ошибка: У дерева более одного корня";
+        break;
+    case ParseError::UnclosedBrackets:
+        out << "Ошибка: незакрытые скобки";
+        break;
+    case ParseError::ReadFailure:
+        out << "Ошибка: не удалось дочитать входные данные";
+        break;
+    }
+
+    out << " (смещение " << result.offset << ")\n";
+}
+
+void Application::printFormatError(FormatError error, std::ostream& out) const
+{
+    switch (error) {
+    case FormatError::None:
+        out << "Ошибок нет\n";
+        break;
+    case FormatError::ReadFailure:
+        out << "Ошибка: не удалось прочитать файл\n";
+        break;
+    case FormatError::WriteFailure:
+        out << "Ошибка: не удалось записать файл\n";
+        break;
+    case FormatError::BadMagic:
+        out << "Ошибка: файл не является сохранённым деревом\n";
+        break;
+    case FormatError::UnsupportedVersion:
+        out << "Ошибка: неподдерживаемая версия формата\n";
+        break;
+    case FormatError::WrongKind:
+        out << "Ошибка: в файле сохранено дерево другого вида\n";
+        break;
+    case FormatError::WrongValueType:
+        out << "Ошибка: в файле сохранены значения другого типа\n";
+        break;
+    case FormatError::Truncated:
+        out << "Ошибка: файл обрезан\n";
+        break;
+    case FormatError::CorruptStructure:
+        out << "Ошибка: структура дерева в файле повреждена\n";
+        break;
+    case FormatError::Unordered:
+        out << "Ошибка: значения в файле нарушают порядок дерева поиска\n";
+        break;
+    case FormatError::Misaligned:
+        out << "Ошибка: значения в буфере не выровнены\n";
+        break;
+    }
+}
+
+void Application::printTreeViolation(TreeViolation violation, std::ostream& out) const
+{
+    switch (violation) {
+    case TreeViolation::None:
+        out << "Все свойства КЧ-дерева выполнены\n";
+        break;
+    case TreeViolation::RedRoot:
+        out << "Ошибка: корень дерева красный\n";
+        break;
+    case TreeViolation::RedRed:
+        out << "Ошибка: у красного узла есть красный ребёнок\n";
+        break;
+    case TreeViolation::BlackHeight:
+        out << "Ошибка: пути к листьям содержат разное число чёрных узлов\n";
+        break;
+    case TreeViolation::BrokenParent:
+        out << "Ошибка: указатель на родителя не совпадает с родителем\n";
+        break;
+    case TreeViolation::Unordered:
+        out << "Ошибка: значения нарушают порядок дерева поиска\n";
+        break;
+    case TreeViolation::WrongSize:
+        out << "Ошибка: размер поддерева в узле неверен\n";
+        break;
+    case TreeViolation::WrongCount:
+        out << "Ошибка: число элементов дерева не совпадает с числом узлов\n";
+        break;
+    }
+}
+
+// Гистограммы выводятся только по непустым ячейкам
+void Application::printTreeStats(const TreeStatsSnapshot& stats, std::ostream& out) const
+{
+    if (!TreeStats::enabled) {
+        out << "Статистика не собирается: программа собрана без RBTREE_STATS\n";
+        return;
+    }
+
+    out << "Повороты: " << stats.rotations << '\n';
+    out << "Проходы восстановления после вставки: " << stats.insertFixups << '\n';
+    out << "Проходы восстановления после удаления: " << stats.deleteFixups << '\n';
+    out << "Перекрашивания: " << stats.recolorings << '\n';
+
+    const char* titles[] = { "Узлов просмотрено при поиске (узлов: поисков)", "Высота дерева (высота: раз)" };
+    const uint64_t* histograms[] = { stats.searchDepth, stats.heights };
+    for (size_t h = 0; h < 2; h++) {
+        out << titles[h] << ':';
+        bool empty = true;
+        for (size_t i = 0; i < TreeStatsSnapshot::histogramSize; i++) {
+            if (!histograms[h][i]) continue;
+            out << ' ' << i << (i + 1 == TreeStatsSnapshot::histogramSize ? "+" : "") << ": " << histograms[h][i];
+            empty = false;
+        }
+        out << (empty ? " нет данных\n" : "\n");
+    }
+}
+
+// Обычный файл разбирается прямо по отображённым в память страницам,
+// канал или устройство — потоком, кусками
+bool Application::readBracketFile(const std::string& path, BinaryTree<number>& binaryTree, ParseResult& result) const
+{
+    MappedFile mappedBracketFile(path);
+    if (mappedBracketFile.isOpen()) {
+        result = binaryTree.buildParallel(mappedBracketFile.data(), mappedBracketFile.size());
+        return true;
+    }
+
+    std::ifstream inputBracketFile(path);
+    if (!inputBracketFile) return false;
+    result = binaryTree.build(inputBracketFile);
+    return true;
+}
+
+void Application::writeTraversal(Traversal order, const RedBlackTree<number>& redBlackTree, OutputBuffer& out) const
+{
+    auto write = [&out](const number& value) { out.value(value); };
+    switch (order) {
+    case Traversal::PreOrder:
+        redBlackTree.visitPreOrder(write);
+        break;
+    case Traversal::InOrder:
+        for (const number& value : redBlackTree) {
+            out.value(value);
+        }
+        break;
+    case Traversal::PostOrder:
+        redBlackTree.visitPostOrder(write);
+        break;
+    case Traversal::BreadthFirst:
+        redBlackTree.visitBreadthFirst(write);
+        break;
+    }
+    out.endLine();
+}
+
+// Заголовок идёт через std::cout, значения — мимо него, поэтому cout сбрасывается первым
+void Application::printTraversal(const char* title, Traversal order, const RedBlackTree<number>& redBlackTree) const
+{
+    if (redBlackTree.empty()) {
+        std::cout << "Дерево не содержит элементов\n";
+        return;
+    }
+
+    std::cout << title;
+    std::cout.flush();
+    OutputBuffer out;
+    writeTraversal(order, redBlackTree, out);
+}
+
+// Параметры через пробел: topdown или sideways (по умолчанию), depth=N, width=N,
+// path=LR... (путь от корня), from=значение (только КЧ-дерево), file=путь — до конца строки
+bool Application::parseTreeView(const std::string& text, TreeView& view, std::ostream& errors) const
+{
+    std::istringstream words(text);
+    std::string word;
+    while (words >> word) {
+        size_t equals = word.find('=');
+        std::string key = word.substr(0, equals);
+        std::string value = equals == std::string::npos ? std::string() : word.substr(equals + 1);
+        std::istringstream valueStream(value);
+
+        bool ok = true;
+        if (word == "topdown") view.options.layout = TreeLayout::TopDown;
+        else if (word == "sideways") view.options.layout = TreeLayout::Sideways;
+        else if (key == "depth") ok = valueStream >> view.options.maxDepth && valueStream.eof() && view.options.maxDepth >= 0;
+        else if (key == "width") ok = valueStream >> view.options.maxLevelWidth && valueStream.eof();
+        else if (key == "path") view.options.path = value;
+        else if (key == "from") ok = view.hasFrom = valueStream >> view.from && valueStream.eof();
+        else if (key == "file") {
+            std::string rest;
+            std::getline(words, rest);
+            view.file = value + rest;
+            ok = !view.file.empty();
+        }
+        else ok = false;
+
+        if (!ok) {
+            errors << "Ошибка: некорректный параметр вывода " << word << '\n';
+            return false;
         }
+    }
+    return true;
+}
+
+template <typename Render>
+bool Application::writeTreeView(const TreeView& view, OutputBuffer& out, std::ostream& errors, Render render) const
+{
+    if (view.file.empty()) {
+        if (render(out)) return true;
+        errors << "Ошибка: в дереве нет выбранного поддерева\n";
+        return false;
+    }
+
+    OutputBuffer file(-1);
+    if (!file.open(view.file)) {
+        errors << "Ошибка при записи файла " << view.file << '\n';
+        return false;
+    }
+    if (!render(file)) {
+        errors << "Ошибка: в дереве нет выбранного поддерева\n";
+        return false;
+    }
+    file.close();
+    if (!file.good()) {
+        errors << "Ошибка при записи файла " << view.file << '\n';
+        return false;
+    }
+    return true;
+}
 
-        if (ch == '(') {
-            if (!isPrevUnclosedBracket) {
-                unclosedBrackets++;
-                countInLevels.push(0);
-                isPrevUnclosedBracket = true;
+// Команды сценария, по одной в строке (пустые строки и строки с # пропускаются):
+//   load <путь>                  — прочитать скобочную запись из файла в двоичное дерево
+//   parse <запись>               — разобрать скобочную запись из самой строки
+//   build                        — построить КЧ-дерево по двоичному, как пункт меню
+//   insert|search|delete <ключи> — пакетные операции над КЧ-деревом
+//   preorder|inorder|postorder|bfs [путь] — вывести обход КЧ-дерева одной строкой
+//                                  в stdout или записать в файл
+//   format text|binary           — формат следующих обходов: текст или побайтовые копии number
+//   tree binary|rb [параметры]   — вывести дерево или его часть, параметры как у parseTreeView
+//   save|open <путь>             — сохранить или загрузить КЧ-дерево в двоичном файле
+//   size, validate
+//   stats [reset]                — счётчики операций КЧ-деревьев (нужна сборка с RBTREE_STATS)
+// Результаты копятся в OutputBuffer и пишутся в stdout крупными кусками; ошибки
+// и время каждой команды — в stderr. Ошибочная команда не прерывает сценарий,
+// но код завершения будет 1
+int Application::runBatch(std::istream& script, BinaryTree<number>& binaryTree, RedBlackTree<number>& redBlackTree)
+{
+    typedef std::chrono::steady_clock Clock;
+
+    OutputBuffer output;
+    std::string line;
+    size_t lineNumber = 0;
+    int failures = 0;
+    Clock::time_point scriptStart = Clock::now();
+
+    while (std::getline(script, line)) {
+        lineNumber++;
+        std::istringstream arguments(line);
+        std::string command;
+        if (!(arguments >> command) || command[0] == '#') continue;
+
+        std::string argument;
+        std::getline(arguments >> std::ws, argument);
+
+        std::vector<number> keys;
+        if (command == "insert" || command == "search" || command == "delete") {
+            std::istringstream keyStream(argument);
+            number key;
+            while (keyStream >> key) {
+                keys.push_back(key);
             }
-            else {
-                std::cout << ":  .  \n";
-                return false;
+            if (!keyStream.eof()) {
+                std::cerr << "строка " << lineNumber << ": ключи не были прочтены\n";
+                failures++;
+                continue;
             }
         }
 
-        else if (ch == ')') {
-            if (unclosedBrackets <= 0) {
-                std::cout << ":   \n";
-                return false;
+        Clock::time_point start = Clock::now();
+        bool failed = false;
+
+        if (command == "load" || command == "parse") {
+            ParseResult result;
+            if (command == "load" && !readBracketFile(argument, binaryTree, result)) {
+                std::cerr << "строка " << lineNumber << ": ошибка при открытии файла " << argument << '\n';
+                failed = true;
             }
-            if (countInLevels.top() == 0) {
-                std::cout << ":     \n";
-                return false;
+            else {
+                if (command == "parse") result = binaryTree.build(argument);
+                if (!result.ok()) {
+                    std::cerr << "строка " << lineNumber << ": ";
+                    printParseError(result, std::cerr);
+                    failed = true;
+                }
             }
-            unclosedBrackets--;
-            countInLevels.pop();
-            if (!countInLevels.empty()) countInLevels.top()++;
-            isPrevUnclosedBracket = false;
-
-            if (!countInLevels.empty() && countInLevels.top() >= 4) {
-                std::cout << ":    2 \n";
-                return false;
+        }
+        else if (command == "build") {
+            redBlackTree.bulkLoad(binaryTree.postOrder());
+        }
+        else if (command == "insert") {
+            redBlackTree.insertBatch(keys);
+        }
+        else if (command == "search") {
+            std::unique_ptr<bool[]> found(new bool[keys.size()]);
+            redBlackTree.searchBatch(keys.data(), keys.size(), found.get());
+            size_t foundCount = 0;
+            for (size_t i = 0; i < keys.size(); i++) {
+                foundCount += found[i];
             }
+            output.number(foundCount);
+            output.text("\n", 1);
         }
-
-        else if (std::isdigit(ch) || (ch == '-' && (i + 1) < str.size() && std::isdigit(str[i + 1]))) {
-            
-            if (isPrevUnclosedBracket) {
-                countInLevels.top()++;
-                while (i + 1 < str.size() && std::isdigit(str[i + 1])) {
-                    i++;
+        else if (command == "delete") {
+            output.number(redBlackTree.eraseBatch(keys));
+            output.text("\n", 1);
+        }
+        else if (command == "preorder" || command == "inorder" || command == "postorder" || command == "bfs") {
+            Traversal order = Traversal::BreadthFirst;
+            if (command == "preorder") order = Traversal::PreOrder;
+            else if (command == "inorder") order = Traversal::InOrder;
+            else if (command == "postorder") order = Traversal::PostOrder;
+
+            if (argument.empty()) {
+                writeTraversal(order, redBlackTree, output);
+            }
+            else {
+                OutputBuffer file(-1, output.format());
+                failed = !file.open(argument);
+                if (!failed) {
+                    writeTraversal(order, redBlackTree, file);
+                    file.close();
+                    failed = !file.good();
+                }
+                if (failed) {
+                    std::cerr << "строка " << lineNumber << ": ошибка при записи файла " << argument << '\n';
+                }
+            }
+        }
+        else if (command == "tree") {
+            std::istringstream treeArguments(argument);
+            std::string which;
+            treeArguments >> which;
+            std::string parameters;
+            std::getline(treeArguments >> std::ws, parameters);
+
+            TreeView view;
+            std::ostringstream errors;
+            if (which != "binary" && which != "rb") {
+                errors << "Ошибка: нужно указать дерево binary или rb\n";
+                failed = true;
+            }
+            else if (!parseTreeView(parameters, view, errors)) {
+                failed = true;
+            }
+            else if (which == "binary") {
+                if (view.hasFrom) {
+                    errors << "Ошибка: from есть только у КЧ-дерева\n";
+                    failed = true;
+                }
+                else {
+                    failed = !writeTreeView(view, output, errors, [&](OutputBuffer& out) {
+                        return binaryTree.render(out, view.options);
+                    });
                 }
-                isPrevUnclosedBracket = false;
             }
             else {
-                std::cout << ":   \n";
-                return false;
+                failed = !writeTreeView(view, output, errors, [&](OutputBuffer& out) {
+                    return view.hasFrom ? redBlackTree.render(out, view.options, view.from) : redBlackTree.render(out, view.options);
+                });
+            }
+            if (failed) {
+                std::cerr << "строка " << lineNumber << ": " << errors.str();
+            }
+        }
+        else if (command == "format") {
+            if (argument == "text") output.setFormat(OutputFormat::Text);
+            else if (argument == "binary") output.setFormat(OutputFormat::Binary);
+            else {
+                std::cerr << "строка " << lineNumber << ": неизвестный формат " << argument << '\n';
+                failed = true;
+            }
+        }
+        else if (command == "save" || command == "open") {
+            FormatError error = command == "save" ? redBlackTree.saveFile(argument) : redBlackTree.loadFile(argument);
+            if (error != FormatError::None) {
+                std::cerr << "строка " << lineNumber << ": ";
+                printFormatError(error, std::cerr);
+                failed = true;
+            }
+        }
+        else if (command == "size") {
+            output.number(redBlackTree.size());
+            output.text("\n", 1);
+        }
+        else if (command == "validate") {
+            TreeViolation violation = redBlackTree.validate();
+            std::ostringstream message;
+            printTreeViolation(violation, message);
+            output.text(message.str());
+            failed = violation != TreeViolation::None;
+        }
+        else if (command == "stats") {
+            if (argument == "reset") {
+                TreeStats::reset();
+            }
+            else {
+                std::ostringstream message;
+                printTreeStats(TreeStats::snapshot(), message);
+                output.text(message.str());
             }
         }
-
         else {
-            std::cout << ":   '" << ch << "'\n";
-            return false;
+            std::cerr << "строка " << lineNumber << ": неизвестная команда " << command << '\n';
+            failed = true;
         }
-    }
 
-    if (unclosedBrackets != 0) {
-        std::cout << ":  \n";
-        return false;
+        double milliseconds = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        std::cerr << "строка " << lineNumber << ", " << command << ": " << milliseconds << " мс\n";
+        failures += failed;
     }
 
-    return true;
+    if (!output.flush()) {
+        std::cerr << "Ошибка при записи в stdout\n";
+        failures++;
+    }
+    double total = std::chrono::duration<double, std::milli>(Clock::now() - scriptStart).count();
+    std::cerr << "всего: " << total << " мс\n";
+    return failures ? 1 : 0;
 }
 
-
 void Application::exec(BinaryTree<number>& binaryTree, RedBlackTree<number>& redBlackTree)
 {
     const char separator[] = "------------------------------------------------------------------------------------------------------------------------";
     const char commands[] =
-        "1)  \n"
-        "2) -\n"
-        "c)   \n"
-        "e)   \n";
+        "1) Двоичное дерево\n"
+        "2) КЧ-дерево\n"
+        "c) Вывести список комманд\n"
+        "e) Выход из программы\n";
 
     std::string command = "c";
 
     do {
         if (command == "e") {
-            std::cout << "  \n";
+            std::cout << "Программа завершена пользователем\n";
             break;
         }
         else if (command == "c") {
@@ -123,14 +528,15 @@ void Application::exec(BinaryTree<number>& binaryTree, RedBlackTree<number>& red
         }
         else if (command == "1") {
             const std::string bTreeCommands = 
-                "1)     \n"
-                "2)     \n"
-                "3)    (post-order)\n"
-                "r)      \n"
-                "h)      \n"
-                "s)   \n"
-                "c)   \n"
-                "<)    \n";
+                "1) Ввести скобочную запись в консоль\n"
+                "2) Прочитать скобочную запись из файла\n"
+                "3) Обход дерева в глубину(post-order)\n"
+                "r) Изменить путь файла со скобочной записью\n"
+                "h) Вывести путь к файлу по умолчанию\n"
+                "s) Вывести бинарное дерево\n"
+                "p) Вывести часть дерева (глубина, поддерево, файл)\n"
+                "c) Вывести список комманд\n"
+                "<) Вернуться в главное меню\n";
 
             command = "c";
 
@@ -148,89 +554,107 @@ void Application::exec(BinaryTree<number>& binaryTree, RedBlackTree<number>& red
                     //binaryTree.print();
                     binaryTree.printSecond();
                 }
+                else if (command == "p") {
+                    std::cout << "Параметры (topdown, depth=N, width=N, path=LR..., file=путь): ";
+                    std::string parameters;
+                    std::getline(std::cin, parameters);
+                    TreeView view;
+                    if (std::cin.fail()) {
+                        std::cerr << "Параметры не были прочтены\n";
+                    }
+                    else if (parseTreeView(parameters, view, std::cerr)) {
+                        if (view.hasFrom) {
+                            std::cerr << "Ошибка: from есть только у КЧ-дерева\n";
+                        }
+                        else {
+                            std::cout.flush();
+                            OutputBuffer out;
+                            writeTreeView(view, out, std::cerr, [&](OutputBuffer& out) {
+                                return binaryTree.render(out, view.options);
+                            });
+                        }
+                    }
+                }
                 else if (command == "h") {
-                    std::cout << "    : " << pathToBracketTree << '\n';
+                    std::cout << "Путь к файлу по умолчанию: " << pathToBracketTree << '\n';
                 }
                 else if (command == "r") {
-                    std::cout << "      : ";
+                    std::cout << "Введите абсолютный или относительный путь до файла: ";
                     std::getline(std::cin, pathToBracketTree);
                     if (!std::cin.fail()) {
-                        std::cout << "     : " << pathToBracketTree << '\n';
+                        std::cout << "Путь к файлу был изменён на: " << pathToBracketTree << '\n';
                     }
                     else {
-                        std::cerr << "   \n";
+                        std::cerr << "Путь не был перезаписан\n";
                     }
                 }
                 else if (command == "1") {
-                    std::cout << "  : ";
+                    std::cout << "Введите скобочную последовательность: ";
                     std::string bracketTree;
                     std::getline(std::cin, bracketTree);
                     std::cin.ignore(1000000, '\n');
                     if (!std::cin.fail()) {
-                        if (isValidTree(bracketTree)) {
-                            // (8 (9 (5)) (1))
-                            // (9 (6 (3 (1 (2)) (4 (5))) (8 (7))) (17 (16 (12 (11 (10)) (14 (13) (15)))) (20 (19 (18)) (21))))
-                            std::cout << " \n";
-                            binaryTree.build(bracketTree);
-                            std::cout << "  \n";
+                        // (8 (9 (5)) (1))
+                        // (9 (6 (3 (1 (2)) (4 (5))) (8 (7))) (17 (16 (12 (11 (10)) (14 (13) (15)))) (20 (19 (18)) (21))))
+                        ParseResult result = binaryTree.build(bracketTree);
+                        if (result.ok()) {
+                            std::cout << "Форма корректна\n";
+                            std::cout << "Дерево было построено\n";
+                        }
+                        else {
+                            printParseError(result);
                         }
                     }
                     else {
-                        std::cerr << "   \n";
+                        std::cerr << "Последовательность не была прочтена\n";
                     }
                 }
                 else if (command == "2") {
-                    std::ifstream inputBracketFile(pathToBracketTree);
-                    if (inputBracketFile) { 
-                        std::string bracketTree;
-                        std::getline(inputBracketFile, bracketTree);
-                        
-                        if (!inputBracketFile.fail()) {
-                            if (isValidTree(bracketTree)) {
-                                std::cout << "    ,  \n";
-                                binaryTree.build(bracketTree);
-                                std::cout << "  \n";
-                            }
-                            else {
-                                std::cout << "    ,  \n";
-                            }
+                    ParseResult result;
+                    bool isFileRead = readBracketFile(pathToBracketTree, binaryTree, result);
+
+                    if (isFileRead) {
+                        if (result.ok()) {
+                            std::cout << "С файла была прочтена форма, она корректна\n";
+                            std::cout << "Дерево было построено\n";
+                        }
+                        else if (result.error == ParseError::ReadFailure) {
+                            std::cerr << "Ошибка: Строка не была прочтена из файла\n";
                         }
                         else {
-                            std::cerr << ":      \n";
+                            printParseError(result);
+                            std::cout << "С файла была прочтена форма, она некорректна\n";
                         }
-
-                        inputBracketFile.close();
                     }
                     else {
-                        std::cerr << "   !\n";
+                        std::cerr << "Ошибка при открытии файла!\n";
                     }
                 }
                 else if (command == "3") {
                     if (!binaryTree.empty()) {
-                        std::cout << " post-order: ";
-                        std::vector<number> postOrder = binaryTree.postOrder();
-                        for (size_t i = 0; i < postOrder.size(); i++) {
-                            std::cout << postOrder[i] << ' ';
-                        }
-                        std::cout << '\n';
+                        std::cout << "Обход post-order: ";
+                        std::cout.flush();
+                        OutputBuffer out;
+                        binaryTree.visitPostOrder([&out](const number& value) { out.value(value); });
+                        out.endLine();
                     }
                     else {
-                        std::cout << "   \n";
+                        std::cout << "Дерево не содержит элементов\n";
                     }
                 }
 
                 else {
-                    std::cout << " .  .\n";
+                    std::cout << "Некорректная команда. Попробуйте снова.\n";
                 }
 
                 std::cout << separator << '\n';
-                std::cout << " : ";
+                std::cout << "Введите команду: ";
                 std::getline(std::cin, command);
 
                 if (std::cin.fail()) {
                     std::cin.clear();
                     //std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-                    std::cout << " !  .\n";
+                    std::cout << "Некорректный ввод! Попробуйте снова.\n";
                     command = "c";
                 }
 
@@ -240,16 +664,22 @@ void Application::exec(BinaryTree<number>& binaryTree, RedBlackTree<number>& red
         }
         else if (command == "2") {
             const std::string RBTreeCommands =
-                "1)  -,      \n"
-                "2)    (pre-order)\n"
-                "3)    (in-order)\n"
-                "4)    (post-order)\n"
-                "5)    \n"
-                "6)    \n"
-                "7)    \n"
-                "s)   \n"
-                "c)   \n"
-                "<)    \n";
+                "1) Создать КЧ-дерево, на основе уже имеющегося бинарного дерева\n"
+                "2) Обход дерева в глубину(pre-order)\n"
+                "3) Обход дерева в глубину(in-order)\n"
+                "4) Обход дерева в глубину(post-order)\n"
+                "5) Обход дерева в ширину\n"
+                "6) Поиск элемента в дереве\n"
+                "7) Удалить элемент по значению\n"
+                "8) Сохранить дерево в двоичный файл\n"
+                "9) Загрузить дерево из двоичного файла\n"
+                "v) Проверить свойства КЧ-дерева\n"
+                "t) Статистика операций КЧ-дерева\n"
+                "z) Обнулить статистику операций\n"
+                "s) Вывести бинарное дерево\n"
+                "p) Вывести часть дерева (глубина, поддерево, файл)\n"
+                "c) Вывести список комманд\n"
+                "<) Вернуться в главное меню\n";
 
             command = "c";
 
@@ -262,127 +692,131 @@ void Application::exec(BinaryTree<number>& binaryTree, RedBlackTree<number>& red
                     std::cout << commands;
                     break;
                 }
+                else if (command == "v") {
+                    printTreeViolation(redBlackTree.validate());
+                }
+                else if (command == "t") {
+                    printTreeStats(TreeStats::snapshot());
+                }
+                else if (command == "z") {
+                    TreeStats::reset();
+                    std::cout << "Статистика обнулена\n";
+                }
                 else if (command == "s") {
                     std::cout << "Red-Black Tree structure:" << std::endl;
                     //redBlackTree.print();
                     redBlackTree.printSecond();
                 }
+                else if (command == "p") {
+                    std::cout << "Параметры (topdown, depth=N, width=N, path=LR..., from=значение, file=путь): ";
+                    std::string parameters;
+                    std::getline(std::cin, parameters);
+                    TreeView view;
+                    if (std::cin.fail()) {
+                        std::cerr << "Параметры не были прочтены\n";
+                    }
+                    else if (parseTreeView(parameters, view, std::cerr)) {
+                        std::cout.flush();
+                        OutputBuffer out;
+                        writeTreeView(view, out, std::cerr, [&](OutputBuffer& out) {
+                            return view.hasFrom ? redBlackTree.render(out, view.options, view.from) : redBlackTree.render(out, view.options);
+                        });
+                    }
+                }
                 else if (command == "1") {
                     if (!binaryTree.empty()) {
-                        redBlackTree.buildTree(binaryTree.postOrder());
+                        redBlackTree.bulkLoad(binaryTree.postOrder());
                         if (!redBlackTree.empty()) {
-                            std::cout << "-   \n";
+                            std::cout << "КЧ-дерево было успешно заполнено\n";
                         }
                         else {
-                            std::cout << "-   \n";
+                            std::cout << "КЧ-дерево не было заполнено\n";
                         }
                     }
                     else {
-                        std::cout << ":   -,     \n";
+                        std::cout << "Ошибка: Нельзя создать КЧ-дерево, бинарное дерево не содержит элементов\n";
                     }
                    
                 }
                 else if (command == "2") {
-                    if (!redBlackTree.empty()) {
-                        std::cout << " pre-order: ";
-                        std::vector<number> preOrder = redBlackTree.preOrder();
-                        for (size_t i = 0; i < preOrder.size(); i++) {
-                            std::cout << preOrder[i] << ' ';
-                        }
-                        std::cout << '\n';
-                    }
-                    else {
-                        std::cout << "   \n";
-                    }
+                    printTraversal("Обход pre-order: ", Traversal::PreOrder, redBlackTree);
                 }
                 else if (command == "3") {
-                    if (!redBlackTree.empty()) {
-                        std::cout << " in-order: ";
-                        std::vector<number> inOrder = redBlackTree.inOrder();
-                        for (size_t i = 0; i < inOrder.size(); i++) {
-                            std::cout << inOrder[i] << ' ';
-                        }
-                        std::cout << '\n';
-                    }
-                    else {
-                        std::cout << "   \n";
-                    }
+                    printTraversal("Обход in-order: ", Traversal::InOrder, redBlackTree);
                 }
                 else if (command == "4") {
-                    if (!redBlackTree.empty()) {
-                        std::cout << " post-order: ";
-                        std::vector<number> postOrder = redBlackTree.postOrder();
-                        for (size_t i = 0; i < postOrder.size(); i++) {
-                            std::cout << postOrder[i] << ' ';
-                        }
-                        std::cout << '\n';
-                    }
-                    else {
-                        std::cout << "   \n";
-                    }
+                    printTraversal("Обход post-order: ", Traversal::PostOrder, redBlackTree);
                 }
                 else if (command == "5") {
-                    if (!redBlackTree.empty()) {
-                        std::cout << "  : ";
-                        std::vector<number> breadthFirst = redBlackTree.breadthFirstTraversal();
-                        for (size_t i = 0; i < breadthFirst.size(); i++) {
-                            std::cout << breadthFirst[i] << ' ';
-                        }
-                        std::cout << '\n';
-                    }
-                    else {
-                        std::cout << "   \n";
-                    }
+                    printTraversal("Обход в ширину: ", Traversal::BreadthFirst, redBlackTree);
                 }
                 else if (command == "6") {
-                    std::cout << "  : ";
+                    std::cout << "Введите значение элемента: ";
                     number value;
                     std::cin >> value;
                     std::cin.ignore(1000000, '\n');
                     if (!std::cin.fail()) {
                         bool isThereElem = redBlackTree.search(value);
                         if (isThereElem) {
-                            std::cout << "   \n";
+                            std::cout << "Элемент был успешно найден\n";
                         }
                         else {
-                            std::cout << "   \n";
+                            std::cout << "Элемент не был найден\n";
                         }
                     }
                     else {
-                        std::cerr << "    \n";
+                        std::cerr << "Значение элемента не было прочтено\n";
                     }
                 }
                 else if (command == "7") {
-                    std::cout << "  : ";
+                    std::cout << "Введите значение элемента: ";
                     number value;
                     std::cin >> value;
                     std::cin.ignore(1000000, '\n');
                     if (!std::cin.fail()) {
                         bool wasRemoved = redBlackTree.deleteNode(value);
                         if (wasRemoved) {
-                            std::cout << "   \n";
+                            std::cout << "Элемент был успешно удалён\n";
+                        }
+                        else {
+                            std::cout << "Элемент не был удален, так как такого элемента нет в дереве\n";
+                        }
+                    }
+                    else {
+                        std::cerr << "Значение элемента не было прочтено\n";
+                    }
+                }
+                else if (command == "8" || command == "9") {
+                    std::cout << "Введите путь до двоичного файла: ";
+                    std::string pathToTreeFile;
+                    std::getline(std::cin, pathToTreeFile);
+                    if (!std::cin.fail()) {
+                        FormatError error = command == "8" ? redBlackTree.saveFile(pathToTreeFile)
+                                                           : redBlackTree.loadFile(pathToTreeFile);
+                        if (error == FormatError::None) {
+                            std::cout << (command == "8" ? "Дерево было сохранено\n" : "Дерево было загружено\n");
                         }
                         else {
-                            std::cout << "   ,       \n";
+                            printFormatError(error);
                         }
                     }
                     else {
-                        std::cerr << "    \n";
+                        std::cerr << "Путь не был прочтен\n";
                     }
                 }
                 else {
-                    std::cout << " .  .\n";
+                    std::cout << "Некорректная команда. Попробуйте снова.\n";
                 }
        
 
                 std::cout << separator << '\n';
-                std::cout << " : ";
+                std::cout << "Введите команду: ";
                 std::getline(std::cin, command);
 
                 if (std::cin.fail()) {
                     std::cin.clear();
                     //std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-                    std::cout << " !  .\n";
+                    std::cout << "Некорректный ввод! Попробуйте снова.\n";
                     command = "c";
                 }
 
@@ -391,17 +825,17 @@ void Application::exec(BinaryTree<number>& binaryTree, RedBlackTree<number>& red
             } while (true);
         }
         else {
-            std::cout << " .  .\n";
+            std::cout << "Некорректная команда. Попробуйте снова.\n";
         }
 
         std::cout << separator << '\n';
-        std::cout << " : ";
+        std::cout << "Введите команду: ";
         std::getline(std::cin, command);
 
         if (std::cin.fail()) {
             std::cin.clear();
             //std::cin.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-            std::cout << " !  .\n";
+            std::cout << "Некорректный ввод! Попробуйте снова.\n";
             command = "c";
         }
 
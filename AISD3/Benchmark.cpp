@@ -0,0 +1,785 @@
+﻿// Замеры производительности деревьев (отдельная программа, не входит в AISD3.vcxproj).
+// Сборка: цель benchmark в CMakeLists.txt или g++ -O2 -std=c++17 -pthread Benchmark.cpp -o benchmark
+// Запуск: benchmark [--sizes=1e3,1e4,1e5,1e6] [--distributions=sequential,random,adversarial]
+//                   [--filter=подстрока] [--format=console|json|csv] [--out=файл]
+// Строки результатов по ходу выводятся в stderr, итог в выбранном формате — в stdout или в файл
+
+#include "Benchmark.h"
+#include "RedBlackTree.h"
+#include "ConcurrentRedBlackTree.h"
+#include "PersistentRedBlackTree.h"
+#include "CompactRedBlackTree.h"
+#include "MappedFile.h"
+#include "OutputBuffer.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Подсчёт всех выделений памяти программы: сколько байт и сколько раз.
+// GCC видит free() в operator delete после встраивания и ошибочно считает пару new/free несовместимой
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+void* operator new(size_t size)
+{
+    benchmarkBytesAllocated.fetch_add(size, std::memory_order_relaxed);
+    benchmarkAllocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* memory = std::malloc(size ? size : 1)) return memory;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+    std::free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    std::free(memory);
+}
+
+// Результаты складываются сюда, чтобы компилятор не выбросил замеряемый код
+static volatile size_t benchmarkSink;
+
+enum class Distribution { Sequential, Random, Adversarial };
+
+static const char* distributionName(Distribution distribution)
+{
+    switch (distribution) {
+    case Distribution::Sequential: return "sequential";
+    case Distribution::Random: return "random";
+    default: return "adversarial";
+    }
+}
+
+// sequential — 0, 1, 2, ...; random — те же ключи в случайном порядке;
+// adversarial — «пила» 0, n-1, 1, n-2, ...: каждая вставка идёт на край дерева
+// и чередует стороны, поэтому повороты случаются почти на каждом шаге
+static std::vector<double> makeKeys(Distribution distribution, size_t count)
+{
+    std::vector<double> keys(count);
+    if (distribution == Distribution::Adversarial) {
+        size_t low = 0, high = count;
+        for (size_t i = 0; i < count; i++) {
+            keys[i] = static_cast<double>((i % 2) ? --high : low++);
+        }
+        return keys;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        keys[i] = static_cast<double>(i);
+    }
+    if (distribution == Distribution::Random) {
+        std::shuffle(keys.begin(), keys.end(), std::mt19937_64(42));
+    }
+    return keys;
+}
+
+// Скобочная запись дерева из count узлов. Форма зависит от распределения:
+// sequential — полное дерево, random — случайные размеры поддеревьев,
+// adversarial — цепочка "(0 (1 (2 ...)))" глубины count
+static std::string makeBracketTree(Distribution distribution, size_t count)
+{
+    std::mt19937_64 generator(7);
+    std::string bracketTree;
+    bracketTree.reserve(count * 6);
+
+    // 0 в стеке — закрывающая скобка, иначе размер ещё не записанного поддерева
+    std::vector<size_t> pending(1, count);
+    size_t value = 0;
+    while (!pending.empty()) {
+        size_t subtree = pending.back();
+        pending.pop_back();
+        if (subtree == 0) {
+            bracketTree += ')';
+            continue;
+        }
+
+        bracketTree += '(';
+        bracketTree += std::to_string(value++ % 1000);
+
+        size_t left;
+        if (distribution == Distribution::Sequential) left = (subtree - 1) / 2;
+        else if (distribution == Distribution::Random) left = std::uniform_int_distribution<size_t>(0, subtree - 1)(generator);
+        else left = subtree - 1;
+        size_t right = subtree - 1 - left;
+
+        pending.push_back(0);
+        if (right) pending.push_back(right);
+        if (left) pending.push_back(left);
+        if (left || right) bracketTree += ' ';
+    }
+    return bracketTree;
+}
+
+// Половина запросов попадает в дерево, половина — мимо, порядок случайный
+static std::vector<double> makeQueries(const std::vector<double>& keys)
+{
+    std::vector<double> queries(keys);
+    std::shuffle(queries.begin(), queries.end(), std::mt19937_64(11));
+    for (size_t i = 0; i < queries.size(); i += 2) {
+        queries[i] += 0.5;
+    }
+    return queries;
+}
+
+// Вставка и уничтожение дерева с разными аллокаторами узлов
+template <template <typename> class NodeAllocator>
+static void benchmarkAllocator(BenchmarkRunner& runner, const char* allocatorName, const char* distribution,
+                               const std::vector<double>& keys)
+{
+    std::string insertName = std::string("insert/") + allocatorName;
+    std::string clearName = std::string("clear/") + allocatorName;
+    if (!runner.enabled(insertName) && !runner.enabled(clearName)) return;
+
+    RedBlackTree<double, NodeAllocator> tree;
+    runner.run(insertName, distribution, keys.size(), keys.size(), [&] {
+        for (double key : keys) {
+            tree.insert(key);
+        }
+    });
+    runner.run(clearName, distribution, keys.size(), keys.size(), [&] { tree.clear(); });
+}
+
+static void benchmarkRedBlackTree(BenchmarkRunner& runner, Distribution distribution, size_t count)
+{
+    const char* name = distributionName(distribution);
+    std::vector<double> keys = makeKeys(distribution, count);
+    std::vector<double> queries = makeQueries(keys);
+
+    benchmarkAllocator<NewDeleteAllocator>(runner, "new-delete", name, keys);
+    benchmarkAllocator<PoolAllocator>(runner, "pool", name, keys);
+
+    RedBlackTree<double> tree;
+    runner.run("bulkLoad", name, count, count, [&] { tree.bulkLoad(keys); });
+
+    tree.clear();
+    runner.run("insert", name, count, count, [&] {
+        for (double key : keys) {
+            tree.insert(key);
+        }
+    });
+    // Замер вставки отфильтрован: остальным замерам всё равно нужно заполненное дерево
+    if (tree.size() != count) {
+        tree.bulkLoad(keys);
+    }
+
+    runner.run("search", name, count, count, [&] {
+        size_t found = 0;
+        for (double query : queries) {
+            found += tree.search(query) != nullptr;
+        }
+        benchmarkSink = found;
+    });
+
+    std::unique_ptr<bool[]> results(new bool[count]);
+    runner.run("searchBatch", name, count, count, [&] {
+        tree.searchBatch(queries.data(), count, results.get());
+        benchmarkSink = results[0];
+    });
+
+    if (runner.groupEnabled("frozen/")) {
+        FrozenTree<double> frozen = tree.freeze();
+        runner.run("frozen/contains", name, count, count, [&] {
+            size_t found = 0;
+            for (double query : queries) {
+                found += frozen.contains(query);
+            }
+            benchmarkSink = found;
+        });
+        runner.run("frozen/containsBatch", name, count, count, [&] {
+            frozen.containsBatch(queries.data(), count, results.get());
+            benchmarkSink = results[0];
+        });
+    }
+
+    runner.run("inOrder/iterator", name, count, count, [&] {
+        double sum = 0;
+        for (double value : tree) {
+            sum += value;
+        }
+        benchmarkSink = static_cast<size_t>(sum);
+    });
+    runner.run("preOrder/visit", name, count, count, [&] {
+        size_t visited = 0;
+        tree.visitPreOrder([&visited](double) { visited++; });
+        benchmarkSink = visited;
+    });
+    runner.run("postOrder/visit", name, count, count, [&] {
+        size_t visited = 0;
+        tree.visitPostOrder([&visited](double) { visited++; });
+        benchmarkSink = visited;
+    });
+    runner.run("breadthFirst", name, count, count, [&] { benchmarkSink = tree.breadthFirstTraversal().size(); });
+
+    runner.run("deleteNode", name, count, count, [&] {
+        size_t deleted = 0;
+        for (size_t i = 1; i < queries.size(); i += 2) {
+            deleted += tree.deleteNode(queries[i]);
+        }
+        for (size_t i = 0; i < queries.size(); i += 2) {
+            deleted += tree.deleteNode(queries[i] - 0.5);
+        }
+        benchmarkSink = deleted;
+    });
+}
+
+// Операции над множествами через join/split против поэлементной вставки.
+// Второе дерево — каждый второй ключ, сдвинутый на половину шага: половина значений совпадает
+static void benchmarkSetOperations(BenchmarkRunner& runner, Distribution distribution, size_t count)
+{
+    if (!runner.groupEnabled("setops/")) return;
+
+    const char* name = distributionName(distribution);
+    std::vector<double> keys = makeKeys(distribution, count);
+    std::vector<double> otherKeys;
+    for (size_t i = 0; i < keys.size(); i++) {
+        otherKeys.push_back(i % 2 ? keys[i] : keys[i] + 0.5);
+    }
+
+    RedBlackTree<double> tree(keys);
+    RedBlackTree<double> other(otherKeys);
+
+    runner.run("setops/union/insert", name, count, count, [&] {
+        for (double value : other) {
+            tree.insert(value);
+        }
+        benchmarkSink = tree.size();
+    });
+
+    tree.bulkLoad(keys);
+    runner.run("setops/union", name, count, count, [&] {
+        tree.unionWith(other);
+        benchmarkSink = tree.size();
+    });
+
+    tree.bulkLoad(keys);
+    other.bulkLoad(otherKeys);
+    runner.run("setops/intersect", name, count, count, [&] {
+        tree.intersect(other);
+        benchmarkSink = tree.size();
+    });
+
+    tree.bulkLoad(keys);
+    runner.run("setops/difference", name, count, count, [&] {
+        tree.difference(other);
+        benchmarkSink = tree.size();
+    });
+}
+
+// Вывод симметричного обхода в нулевое устройство: поток с operator<< против OutputBuffer.
+// Ключи сдвинуты на треть, чтобы у чисел была дробная часть
+static void benchmarkOutput(BenchmarkRunner& runner, Distribution distribution, size_t count)
+{
+    if (!runner.groupEnabled("output/")) return;
+
+#if defined(_WIN32)
+    const char nullDevice[] = "NUL";
+#else
+    const char nullDevice[] = "/dev/null";
+#endif
+
+    const char* name = distributionName(distribution);
+    std::vector<double> keys = makeKeys(distribution, count);
+    for (double& key : keys) {
+        key += 1.0 / 3;
+    }
+    RedBlackTree<double> tree(keys);
+
+    runner.run("output/ostream", name, count, count, [&] {
+        std::ofstream out(nullDevice);
+        for (double value : tree) {
+            out << value << ' ';
+        }
+        out << '\n';
+    });
+
+    OutputBuffer out(-1);
+    if (!out.open(nullDevice)) return;
+    runner.run("output/text", name, count, count, [&] {
+        for (double value : tree) {
+            out.value(value);
+        }
+        out.endLine();
+        out.flush();
+    });
+
+    out.setFormat(OutputFormat::Binary);
+    runner.run("output/binary", name, count, count, [&] {
+        for (double value : tree) {
+            out.value(value);
+        }
+        out.flush();
+    });
+}
+
+// Полный боковой вид и верхние 8 уровней в обоих видах; последние от размера дерева не зависят
+static void benchmarkRender(BenchmarkRunner& runner, Distribution distribution, size_t count)
+{
+    if (!runner.groupEnabled("render/")) return;
+
+#if defined(_WIN32)
+    const char nullDevice[] = "NUL";
+#else
+    const char nullDevice[] = "/dev/null";
+#endif
+
+    const char* name = distributionName(distribution);
+    RedBlackTree<double> tree(makeKeys(distribution, count));
+    OutputBuffer out(-1);
+    if (!out.open(nullDevice)) return;
+
+    runner.run("render/sideways", name, count, count, [&] {
+        tree.render(out);
+        out.flush();
+    });
+
+    RenderOptions options;
+    options.maxDepth = 8;
+    runner.run("render/sideways-depth8", name, count, 1, [&] {
+        tree.render(out, options);
+        out.flush();
+    });
+
+    options.layout = TreeLayout::TopDown;
+    runner.run("render/topdown-depth8", name, count, 1, [&] {
+        tree.render(out, options);
+        out.flush();
+    });
+}
+
+// Вставка и поиск в данных, где каждое значение повторяется 64 раза
+template <DuplicatePolicy Duplicates>
+static void benchmarkDuplicatePolicy(BenchmarkRunner& runner, const char* policyName, const char* distribution,
+                                     const std::vector<double>& keys, const std::vector<double>& queries)
+{
+    std::string insertName = std::string("dup/insert/") + policyName;
+    std::string searchName = std::string("dup/search/") + policyName;
+    if (!runner.enabled(insertName) && !runner.enabled(searchName)) return;
+
+    RedBlackTree<double, PoolAllocator, false, Duplicates> tree;
+    runner.run(insertName, distribution, keys.size(), keys.size(), [&] {
+        for (double key : keys) {
+            tree.insert(key);
+        }
+    });
+    runner.run(searchName, distribution, keys.size(), queries.size(), [&] {
+        size_t found = 0;
+        for (double query : queries) {
+            found += tree.search(query) != nullptr;
+        }
+        benchmarkSink = found;
+    });
+}
+
+static void benchmarkDuplicates(BenchmarkRunner& runner, Distribution distribution, size_t count)
+{
+    if (!runner.groupEnabled("dup/")) return;
+
+    const char* name = distributionName(distribution);
+    std::vector<double> keys = makeKeys(distribution, count);
+    for (double& key : keys) {
+        key = std::floor(key / 64);
+    }
+    std::vector<double> queries = makeQueries(keys);
+
+    benchmarkDuplicatePolicy<DuplicatePolicy::Multiset>(runner, "multiset", name, keys, queries);
+    benchmarkDuplicatePolicy<DuplicatePolicy::Counted>(runner, "counted", name, keys, queries);
+    benchmarkDuplicatePolicy<DuplicatePolicy::Reject>(runner, "reject", name, keys, queries);
+}
+
+// Пакетные вставка и удаление против поэлементных. Пакеты в 1/16 дерева и размером
+// с дерево идут подъёмами от предыдущего ключа, пакет вдвое больше дерева — слиянием
+static void benchmarkBatch(BenchmarkRunner& runner, Distribution distribution, size_t count)
+{
+    if (!runner.groupEnabled("batch/")) return;
+
+    const char* name = distributionName(distribution);
+    std::vector<double> keys = makeKeys(distribution, count);
+    std::vector<double> small;
+    std::vector<double> large;
+    std::vector<double> merged;
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (i % 16 == 0) small.push_back(keys[i] + 0.5);
+        large.push_back(keys[i] + 0.5);
+        merged.push_back(keys[i] + 0.25);
+        merged.push_back(keys[i] + 0.5);
+    }
+
+    RedBlackTree<double> tree(keys);
+    runner.run("batch/insert/loop", name, count, small.size(), [&] {
+        for (double value : small) {
+            tree.insert(value);
+        }
+        benchmarkSink = tree.size();
+    });
+    runner.run("batch/deleteNode/loop", name, count, small.size(), [&] {
+        size_t deleted = 0;
+        for (double value : small) {
+            deleted += tree.deleteNode(value);
+        }
+        benchmarkSink = deleted;
+    });
+
+    runner.run("batch/insertBatch", name, count, small.size(), [&] {
+        tree.insertBatch(small);
+        benchmarkSink = tree.size();
+    });
+    runner.run("batch/eraseBatch", name, count, small.size(), [&] {
+        benchmarkSink = tree.eraseBatch(small);
+    });
+
+    runner.run("batch/insertBatch/large", name, count, large.size(), [&] {
+        tree.insertBatch(large);
+        benchmarkSink = tree.size();
+    });
+    runner.run("batch/eraseBatch/large", name, count, large.size(), [&] {
+        benchmarkSink = tree.eraseBatch(large);
+    });
+
+    runner.run("batch/insertBatch/merge", name, count, merged.size(), [&] {
+        tree.insertBatch(merged);
+        benchmarkSink = tree.size();
+    });
+    runner.run("batch/eraseBatch/merge", name, count, merged.size(), [&] {
+        benchmarkSink = tree.eraseBatch(merged);
+    });
+}
+
+// Те же вставка, поиск и удаление для дерева на массивах с 32-битными индексами.
+// bytes у вставки включают копирования при росте массивов
+static void benchmarkCompact(BenchmarkRunner& runner, Distribution distribution, size_t count)
+{
+    if (!runner.groupEnabled("compact/")) return;
+
+    const char* name = distributionName(distribution);
+    std::vector<double> keys = makeKeys(distribution, count);
+    std::vector<double> queries = makeQueries(keys);
+
+    CompactRedBlackTree<double> tree;
+    runner.run("compact/insert", name, count, count, [&] {
+        for (double key : keys) {
+            tree.insert(key);
+        }
+    });
+    if (tree.size() != count) {
+        tree.bulkLoad(keys);
+    }
+
+    runner.run("compact/search", name, count, count, [&] {
+        size_t found = 0;
+        for (double query : queries) {
+            found += tree.search(query);
+        }
+        benchmarkSink = found;
+    });
+
+    runner.run("compact/inOrder", name, count, count, [&] { benchmarkSink = tree.inOrder().size(); });
+
+    runner.run("compact/deleteNode", name, count, count, [&] {
+        size_t deleted = 0;
+        for (size_t i = 1; i < queries.size(); i += 2) {
+            deleted += tree.deleteNode(queries[i]);
+        }
+        for (size_t i = 0; i < queries.size(); i += 2) {
+            deleted += tree.deleteNode(queries[i] - 0.5);
+        }
+        benchmarkSink = deleted;
+    });
+}
+
+// Персистентное дерево: каждая версия копирует только путь, снимок стоит O(1).
+// bytes/op у вставки показывает объём скопированного пути
+static void benchmarkPersistent(BenchmarkRunner& runner, Distribution distribution, size_t count)
+{
+    if (!runner.groupEnabled("persistent/")) return;
+
+    const char* name = distributionName(distribution);
+    std::vector<double> keys = makeKeys(distribution, count);
+
+    PersistentRedBlackTree<double> tree;
+    runner.run("persistent/insert", name, count, count, [&] {
+        for (double key : keys) {
+            tree = tree.insert(key);
+        }
+    });
+    if (tree.size() != count) {
+        tree = PersistentRedBlackTree<double>(keys);
+    }
+
+    runner.run("persistent/snapshot", name, count, count, [&] {
+        size_t total = 0;
+        for (size_t i = 0; i < count; i++) {
+            PersistentRedBlackTree<double> snapshot = tree.snapshot();
+            total += snapshot.size();
+        }
+        benchmarkSink = total;
+    });
+
+    runner.run("persistent/deleteNode", name, count, count, [&] {
+        for (double key : keys) {
+            tree = tree.deleteNode(key);
+        }
+        benchmarkSink = tree.size();
+    });
+}
+
+// Поиск без блокировок в ConcurrentRedBlackTree, пока писатель вставляет и удаляет ключи.
+// Каждый читатель делает count поисков: при линейном масштабировании ns/op падает
+// пропорционально числу читателей
+static void benchmarkConcurrent(BenchmarkRunner& runner, Distribution distribution, size_t count)
+{
+    if (!runner.groupEnabled("concurrent/")) return;
+
+    const char* name = distributionName(distribution);
+    std::vector<double> keys = makeKeys(distribution, count);
+    std::vector<double> queries = makeQueries(keys);
+
+    ConcurrentRedBlackTree<double> tree;
+    tree.bulkLoad(keys);
+
+    size_t maxReaders = std::max<size_t>(1, std::thread::hardware_concurrency());
+    for (size_t readers = 1; readers <= maxReaders; readers *= 2) {
+        std::string caseName = "concurrent/contains/" + std::to_string(readers);
+        runner.run(caseName, name, count, count * readers, [&] {
+            std::atomic<bool> stop(false);
+            std::thread writer([&] {
+                // Ключи между существующими: дерево меняется, но запросы не теряют попаданий
+                for (size_t i = 0; !stop.load(std::memory_order_relaxed); i = (i + 1) % count) {
+                    tree.insert(keys[i] + 0.25);
+                    tree.deleteNode(keys[i] + 0.25);
+                }
+            });
+
+            std::vector<std::thread> threads;
+            std::atomic<size_t> found(0);
+            for (size_t reader = 0; reader < readers; reader++) {
+                threads.emplace_back([&, reader] {
+                    ConcurrentRedBlackTree<double>::Reader handle(tree);
+                    size_t hits = 0;
+                    for (size_t i = 0; i < count; i++) {
+                        hits += handle.contains(queries[(i + reader * 7919) % count]);
+                    }
+                    found += hits;
+                });
+            }
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+            stop = true;
+            writer.join();
+            benchmarkSink = found;
+        });
+    }
+}
+
+// Разбор скобочной записи и обходы BinaryTree
+static void benchmarkBinaryTree(BenchmarkRunner& runner, Distribution distribution, size_t count)
+{
+    if (!runner.groupEnabled("parse") && !runner.groupEnabled("binaryTree/")) return;
+
+    const char* name = distributionName(distribution);
+    std::string bracketTree = makeBracketTree(distribution, count);
+    BinaryTree<double> tree;
+
+    runner.run("parse", name, count, count, [&] {
+        ParseResult result = tree.build(bracketTree);
+        benchmarkSink = result.ok();
+    }, bracketTree.size());
+    if (!runner.enabled("parse")) {
+        tree.build(bracketTree);
+    }
+
+    if (runner.enabled("parse/parallel")) {
+        BinaryTree<double> parallelTree;
+        runner.run("parse/parallel", name, count, count, [&] {
+            ParseResult result = parallelTree.buildParallel(bracketTree);
+            benchmarkSink = result.ok();
+        }, bracketTree.size());
+    }
+
+    // Тот же текст из файла: потоковое чтение против разбора отображённых страниц
+    const char* path = "benchmark_bracket_tree.tmp";
+    std::FILE* file = nullptr;
+    if (runner.enabled("parse/file-stream") || runner.enabled("parse/mapped")) {
+        file = std::fopen(path, "wb");
+    }
+    if (file) {
+        std::fwrite(bracketTree.data(), 1, bracketTree.size(), file);
+        std::fclose(file);
+
+        BinaryTree<double> fileTree;
+        runner.run("parse/file-stream", name, count, count, [&] {
+            std::ifstream input(path, std::ios::binary);
+            ParseResult result = fileTree.build(input);
+            benchmarkSink = result.ok();
+        }, bracketTree.size());
+        runner.run("parse/mapped", name, count, count, [&] {
+            MappedFile mapped(path);
+            ParseResult result = fileTree.buildParallel(mapped.data(), mapped.size());
+            benchmarkSink = result.ok();
+        }, bracketTree.size());
+
+        std::remove(path);
+    }
+
+    runner.run("binaryTree/getHeight", name, count, count, [&] { benchmarkSink = tree.getHeight(); });
+    runner.run("binaryTree/postOrder", name, count, count, [&] { benchmarkSink = tree.postOrder().size(); });
+    runner.run("binaryTree/clear", name, count, count, [&] { tree.clear(); });
+}
+
+// Сохранение и загрузка двоичного формата: в буфер, в файл и из отображённого файла
+static void benchmarkFormat(BenchmarkRunner& runner, Distribution distribution, size_t count)
+{
+    if (!runner.groupEnabled("format/")) return;
+
+    const char* name = distributionName(distribution);
+    RedBlackTree<double> tree(makeKeys(distribution, count));
+    std::vector<char> buffer;
+    tree.save(buffer);
+
+    runner.run("format/save", name, count, count, [&] {
+        tree.save(buffer);
+        benchmarkSink = buffer.size();
+    }, buffer.size());
+
+    RedBlackTree<double> loaded;
+    runner.run("format/load", name, count, count, [&] {
+        benchmarkSink = loaded.load(buffer.data(), buffer.size()) == FormatError::None;
+    }, buffer.size());
+
+    const char* path = "benchmark_tree.tmp";
+    runner.run("format/saveFile", name, count, count, [&] {
+        benchmarkSink = tree.saveFile(path) == FormatError::None;
+    }, buffer.size());
+    if (!runner.enabled("format/saveFile")) {
+        tree.saveFile(path);
+    }
+    runner.run("format/loadFile", name, count, count, [&] {
+        benchmarkSink = loaded.loadFile(path) == FormatError::None;
+    }, buffer.size());
+
+    // Снимок из отображённого файла готов к поиску без чтения массива
+    FrozenTree<double> frozen = tree.freeze();
+    const char* frozenPath = "benchmark_frozen.tmp";
+    frozen.saveFile(frozenPath);
+    runner.run("format/frozen/mapFile", name, count, count, [&] {
+        FrozenTree<double> mapped;
+        benchmarkSink = mapped.mapFile(frozenPath) == FormatError::None;
+    });
+
+    std::remove(path);
+    std::remove(frozenPath);
+}
+
+static std::vector<std::string> splitList(const std::string& list)
+{
+    std::vector<std::string> items;
+    size_t first = 0;
+    while (first <= list.size()) {
+        size_t comma = list.find(',', first);
+        if (comma == std::string::npos) comma = list.size();
+        if (comma > first) items.push_back(list.substr(first, comma - first));
+        first = comma + 1;
+    }
+    return items;
+}
+
+static bool startsWith(const std::string& text, const char* prefix, std::string& rest)
+{
+    size_t length = std::strlen(prefix);
+    if (text.compare(0, length, prefix) != 0) return false;
+    rest = text.substr(length);
+    return true;
+}
+
+int main(int argc, char* argv[])
+{
+    std::vector<size_t> sizes = { 1000, 10000, 100000, 1000000 };
+    std::vector<Distribution> distributions = { Distribution::Sequential, Distribution::Random, Distribution::Adversarial };
+    std::string filter;
+    BenchmarkFormat format = BenchmarkFormat::Console;
+    std::string outputPath;
+
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        std::string value;
+        if (startsWith(argument, "--sizes=", value)) {
+            sizes.clear();
+            // Размеры можно задавать в записи 1e6
+            for (const std::string& size : splitList(value)) {
+                sizes.push_back(static_cast<size_t>(std::strtod(size.c_str(), nullptr)));
+            }
+        }
+        else if (startsWith(argument, "--distributions=", value)) {
+            distributions.clear();
+            for (const std::string& distribution : splitList(value)) {
+                if (distribution == "sequential") distributions.push_back(Distribution::Sequential);
+                else if (distribution == "random") distributions.push_back(Distribution::Random);
+                else if (distribution == "adversarial") distributions.push_back(Distribution::Adversarial);
+                else {
+                    std::fprintf(stderr, "unknown distribution: %s\n", distribution.c_str());
+                    return 1;
+                }
+            }
+        }
+        else if (startsWith(argument, "--filter=", value)) {
+            filter = value;
+        }
+        else if (startsWith(argument, "--format=", value)) {
+            if (value == "json") format = BenchmarkFormat::Json;
+            else if (value == "csv") format = BenchmarkFormat::Csv;
+            else format = BenchmarkFormat::Console;
+        }
+        else if (startsWith(argument, "--out=", value)) {
+            outputPath = value;
+        }
+        else {
+            std::fprintf(stderr, "unknown argument: %s\n", argument.c_str());
+            return 1;
+        }
+    }
+
+    BenchmarkRunner runner(filter);
+    for (size_t size : sizes) {
+        if (size == 0) continue;
+        for (Distribution distribution : distributions) {
+            benchmarkRedBlackTree(runner, distribution, size);
+            benchmarkBinaryTree(runner, distribution, size);
+            benchmarkSetOperations(runner, distribution, size);
+            benchmarkBatch(runner, distribution, size);
+            benchmarkDuplicates(runner, distribution, size);
+            benchmarkOutput(runner, distribution, size);
+            benchmarkRender(runner, distribution, size);
+            benchmarkCompact(runner, distribution, size);
+            benchmarkPersistent(runner, distribution, size);
+            benchmarkConcurrent(runner, distribution, size);
+            benchmarkFormat(runner, distribution, size);
+        }
+    }
+
+    if (!outputPath.empty()) {
+        std::FILE* output = std::fopen(outputPath.c_str(), "w");
+        if (!output) {
+            std::fprintf(stderr, "cannot open %s\n", outputPath.c_str());
+            return 1;
+        }
+        runner.write(output, format);
+        std::fclose(output);
+    }
+    else if (format != BenchmarkFormat::Console) {
+        runner.write(stdout, format);
+    }
+
+    return 0;
+}
@@ -0,0 +1,227 @@
+﻿#ifndef BENCHMARK_H
+#define BENCHMARK_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+// Небольшой каркас замеров в духе Google Benchmark для Benchmark.cpp.
+// Каждый замер даёт время на операцию, объём выделенной памяти
+// и, где доступны счётчики perf, число промахов кэша.
+
+// Счётчики выделений: их увеличивает operator new, заменённый в Benchmark.cpp
+inline std::atomic<uint64_t> benchmarkBytesAllocated(0);
+inline std::atomic<uint64_t> benchmarkAllocations(0);
+
+// Аппаратный счётчик промахов кэша последнего уровня (perf_event_open).
+// Вне Linux или без прав на perf available() возвращает false
+class CacheMissCounter {
+public:
+    CacheMissCounter();
+    ~CacheMissCounter();
+
+    CacheMissCounter(const CacheMissCounter&) = delete;
+    CacheMissCounter& operator=(const CacheMissCounter&) = delete;
+
+    bool available() const;
+    void start();
+    uint64_t stop();
+
+private:
+    int descriptor;
+};
+
+struct BenchmarkResult {
+    std::string name;
+    std::string distribution;
+    size_t size;
+    size_t operations;
+    double milliseconds;
+    double nsPerOperation;
+    uint64_t bytesAllocated;
+    uint64_t allocations;
+    int64_t cacheMisses; // -1, если счётчик недоступен
+    double bytesPerSecond; // пропускная способность разбора, 0 для остальных замеров
+};
+
+enum class BenchmarkFormat { Console, Json, Csv };
+
+class BenchmarkRunner {
+public:
+    explicit BenchmarkRunner(const std::string& filter = std::string());
+
+    // Замеряет body(), отнесённый к operations операциям над деревом размера size.
+    // Подготовка данных должна идти до вызова: в замер попадает только body
+    template <typename Body>
+    void run(const std::string& name, const std::string& distribution, size_t size, size_t operations, Body body,
+             size_t processedBytes = 0);
+
+    bool enabled(const std::string& name) const;
+    // Может ли фильтр выбрать хоть один замер группы с общим началом имени group
+    bool groupEnabled(const std::string& group) const;
+    const std::vector<BenchmarkResult>& results() const;
+    void write(std::FILE* output, BenchmarkFormat format) const;
+
+private:
+    std::string filter;
+    CacheMissCounter cacheMisses;
+    std::vector<BenchmarkResult> measured;
+
+    static void printConsoleRow(std::FILE* output, const BenchmarkResult& result);
+};
+
+#if defined(__linux__)
+inline CacheMissCounter::CacheMissCounter() : descriptor(-1)
+{
+    perf_event_attr attributes;
+    std::memset(&attributes, 0, sizeof(attributes));
+    attributes.type = PERF_TYPE_HARDWARE;
+    attributes.size = sizeof(attributes);
+    attributes.config = PERF_COUNT_HW_CACHE_MISSES;
+    attributes.disabled = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    descriptor = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0));
+}
+
+inline CacheMissCounter::~CacheMissCounter()
+{
+    if (descriptor >= 0) close(descriptor);
+}
+
+inline void CacheMissCounter::start()
+{
+    if (descriptor < 0) return;
+    ioctl(descriptor, PERF_EVENT_IOC_RESET, 0);
+    ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+inline uint64_t CacheMissCounter::stop()
+{
+    if (descriptor < 0) return 0;
+    ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+    uint64_t misses = 0;
+    if (read(descriptor, &misses, sizeof(misses)) != static_cast<ssize_t>(sizeof(misses))) return 0;
+    return misses;
+}
+#else
+inline CacheMissCounter::CacheMissCounter() : descriptor(-1) {}
+inline CacheMissCounter::~CacheMissCounter() {}
+inline void CacheMissCounter::start() {}
+inline uint64_t CacheMissCounter::stop() { return 0; }
+#endif
+
+inline bool CacheMissCounter::available() const
+{
+    return descriptor >= 0;
+}
+
+inline BenchmarkRunner::BenchmarkRunner(const std::string& filter) : filter(filter) {}
+
+inline bool BenchmarkRunner::enabled(const std::string& name) const
+{
+    return filter.empty() || name.find(filter) != std::string::npos;
+}
+
+inline bool BenchmarkRunner::groupEnabled(const std::string& group) const
+{
+    return enabled(group) || filter.find(group) != std::string::npos;
+}
+
+template <typename Body>
+void BenchmarkRunner::run(const std::string& name, const std::string& distribution, size_t size, size_t operations, Body body,
+                          size_t processedBytes)
+{
+    if (!enabled(name)) return;
+
+    uint64_t bytesBefore = benchmarkBytesAllocated.load(std::memory_order_relaxed);
+    uint64_t allocationsBefore = benchmarkAllocations.load(std::memory_order_relaxed);
+
+    cacheMisses.start();
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    body();
+    std::chrono::steady_clock::time_point finish = std::chrono::steady_clock::now();
+    uint64_t misses = cacheMisses.stop();
+    uint64_t bytesAfter = benchmarkBytesAllocated.load(std::memory_order_relaxed);
+    uint64_t allocationsAfter = benchmarkAllocations.load(std::memory_order_relaxed);
+
+    BenchmarkResult result;
+    result.name = name;
+    result.distribution = distribution;
+    result.size = size;
+    result.operations = operations;
+    result.milliseconds = std::chrono::duration<double, std::milli>(finish - start).count();
+    result.nsPerOperation = operations ? result.milliseconds * 1e6 / operations : 0;
+    result.bytesAllocated = bytesAfter - bytesBefore;
+    result.allocations = allocationsAfter - allocationsBefore;
+    result.cacheMisses = cacheMisses.available() ? static_cast<int64_t>(misses) : -1;
+    result.bytesPerSecond = processedBytes && result.milliseconds > 0 ? processedBytes * 1e3 / result.milliseconds : 0;
+
+    measured.push_back(result);
+    printConsoleRow(stderr, result);
+}
+
+inline const std::vector<BenchmarkResult>& BenchmarkRunner::results() const
+{
+    return measured;
+}
+
+inline void BenchmarkRunner::printConsoleRow(std::FILE* output, const BenchmarkResult& result)
+{
+    std::fprintf(output, "%-22s %-12s %10zu %12.2f ms %10.1f ns/op %14llu B %10llu allocs", result.name.c_str(),
+                 result.distribution.c_str(), result.size, result.milliseconds, result.nsPerOperation,
+                 static_cast<unsigned long long>(result.bytesAllocated), static_cast<unsigned long long>(result.allocations));
+    if (result.cacheMisses >= 0) {
+        std::fprintf(output, " %12lld misses", static_cast<long long>(result.cacheMisses));
+    }
+    if (result.bytesPerSecond > 0) {
+        std::fprintf(output, " %8.1f MB/s", result.bytesPerSecond / 1e6);
+    }
+    std::fprintf(output, "\n");
+}
+
+inline void BenchmarkRunner::write(std::FILE* output, BenchmarkFormat format) const
+{
+    if (format == BenchmarkFormat::Console) {
+        for (const BenchmarkResult& result : measured) {
+            printConsoleRow(output, result);
+        }
+    }
+    else if (format == BenchmarkFormat::Csv) {
+        std::fprintf(output, "name,distribution,size,operations,ms,ns_per_op,bytes_allocated,allocations,cache_misses,bytes_per_second\n");
+        for (const BenchmarkResult& result : measured) {
+            std::fprintf(output, "%s,%s,%zu,%zu,%.3f,%.2f,%llu,%llu,%lld,%.0f\n", result.name.c_str(), result.distribution.c_str(),
+                         result.size, result.operations, result.milliseconds, result.nsPerOperation,
+                         static_cast<unsigned long long>(result.bytesAllocated), static_cast<unsigned long long>(result.allocations),
+                         static_cast<long long>(result.cacheMisses), result.bytesPerSecond);
+        }
+    }
+    else {
+        std::fprintf(output, "{\n  \"cache_misses_available\": %s,\n  \"benchmarks\": [\n", cacheMisses.available() ? "true" : "false");
+        for (size_t i = 0; i < measured.size(); i++) {
+            const BenchmarkResult& result = measured[i];
+            std::fprintf(output,
+                         "    {\"name\": \"%s\", \"distribution\": \"%s\", \"size\": %zu, \"operations\": %zu, \"ms\": %.3f, "
+                         "\"ns_per_op\": %.2f, \"bytes_allocated\": %llu, \"allocations\": %llu, \"cache_misses\": %lld, "
+                         "\"bytes_per_second\": %.0f}%s\n",
+                         result.name.c_str(), result.distribution.c_str(), result.size, result.operations, result.milliseconds,
+                         result.nsPerOperation, static_cast<unsigned long long>(result.bytesAllocated),
+                         static_cast<unsigned long long>(result.allocations), static_cast<long long>(result.cacheMisses),
+                         result.bytesPerSecond, i + 1 < measured.size() ? "," : "");
+        }
+        std::fprintf(output, "  ]\n}\n");
+    }
+}
+
+#endif // BENCHMARK_H
@@ -1,13 +1,22 @@
 ﻿#ifndef BINARYTREE_H
 #define BINARYTREE_H
 
+#include "NodeAllocator.h"
+#include "BracketParser.h"
+#include "ThreadPool.h"
+#include "TreeFormat.h"
+#include "TreeRenderer.h"
 #include <iostream>
 #include <vector>
 #include <string>
 #include <stack>
 #include <queue>
+#include <algorithm>
+#include <type_traits>
+#include <cstdint>
+#include <memory>
 
-template <typename T>
+template <typename T, template <typename> class NodeAllocator = PoolAllocator>
 class BinaryTree {
 private:
     
@@ -19,241 +28,783 @@ private:
         TreeNode(const T& val);
     };
     
+    // Строит дерево по событиям BracketParser в отдельном аллокаторе
+    struct Builder {
+        NodeAllocator<TreeNode>& allocator;
+        std::vector<TreeNode*> nodeStack;
+        TreeNode* root;
+
+        Builder(NodeAllocator<TreeNode>& allocator);
+        void onNode(const T& value);
+        void onClose();
+    };
+
+    // Верхние уровни при параллельном построении: вместо каждого поддерева-куска
+    // разбирается заглушка "(0)", а место её узла в дереве запоминается
+    struct StitchBuilder {
+        Builder builder;
+        bool placeholderNext;
+        std::vector<TreeNode**> slots;
+        std::vector<TreeNode*> placeholders;
+
+        StitchBuilder(NodeAllocator<TreeNode>& allocator);
+        void onNode(const T& value);
+        void onClose();
+    };
+
+    // Скобка, открывающая или закрывающая узел на глубине depth
+    struct BracketEvent {
+        size_t offset;
+        int depth;
+        bool isOpen;
+    };
+
+    // Меньше этого параллельный разбор не окупает запуск потоков
+    static const size_t minParallelBytes = 1 << 20;
+    // Глубже этого поддеревья-куски не ищутся: событий до неё не больше 2^(maxSplitDepth + 2)
+    static const int maxSplitDepth = 16;
+
     TreeNode* root;
+    NodeAllocator<TreeNode> allocator;
+
+    static void destroySubtree(TreeNode* node, NodeAllocator<TreeNode>& from);
+    static void releaseTree(TreeNode* node, NodeAllocator<TreeNode>& from);
+    void commitBuild(TreeNode* newRoot, NodeAllocator<TreeNode>& newAllocator, const ParseResult& result);
+    void adoptTree(TreeNode* newRoot, NodeAllocator<TreeNode>& newAllocator);
+    static TreeNode* makeThread(TreeNode* target, bool isRight);
+    static bool isThread(const TreeNode* link);
+    static TreeNode* threadTarget(TreeNode* link);
+    static bool threadIsRight(const TreeNode* link);
+    // Обходы по Моррису ниже и все const-методы, которые на них опираются, на время
+    // обхода прошивают дерево через const_cast и восстанавливают его к концу.
+    // Поэтому они не потокобезопасны даже как const: два одновременных вызова на одном
+    // дереве портят его, а visit не должен бросать исключений и заглядывать в дерево
+    template <typename Visit>
+    void reverseInOrder(TreeNode* start, int level, bool isRight, Visit visit) const;
+    // Временно меняет правые указатели
+    template <typename Visit>
+    void visitPreOrder(Visit visit) const;
+    // Через visitPreOrder: временно меняет правые указатели
+    template <typename Walk>
+    void walkForSave(Walk emit) const;
+    size_t countNodes() const;
+    template <typename Visit>
+    static void visitReversed(TreeNode* node, Visit& visit);
+    bool renderFrom(const TreeNode* node, OutputBuffer& out, const RenderOptions& options) const;
 
-    void postOrderTraversal(TreeNode* node, std::vector<T>& res) const;
-    void printSecond(TreeNode* root, int level = 0, bool isRight = false) const;
 
 public:
     BinaryTree();
     ~BinaryTree();
 
+    BinaryTree(const BinaryTree&) = delete;
+    BinaryTree& operator=(const BinaryTree&) = delete;
+
     bool empty() const;
-    void deleteTree(const TreeNode* node) const;
+    void clear();
+    void deleteTree(TreeNode* node);
+    // Обход по Моррису временно меняет левые указатели: одновременно с другими
+    // обходами этого дерева вызывать нельзя, хотя метод и const
     int getHeight(const TreeNode* root) const;
-    void build(const std::string& str);
+    int getHeight() const;
+    ParseResult build(const std::string& str);
+    ParseResult build(const char* data, size_t size);
+    ParseResult build(std::istream& input);
+    ParseResult buildParallel(const std::string& str, ThreadPool& pool = ThreadPool::shared());
+    ParseResult buildParallel(const char* data, size_t size, ThreadPool& pool = ThreadPool::shared());
+    // save временно меняет правые указатели (visitPreOrder): не вызывать одновременно с обходами
+    FormatError save(std::ostream& out) const;
+    void save(std::vector<char>& buffer) const;
+    FormatError saveFile(const std::string& path) const;
+    FormatError load(const char* data, size_t size);
+    FormatError load(std::istream& input);
+    FormatError loadFile(const std::string& path);
+    // Обратный обход без дополнительной памяти, visit(value) для каждого узла.
+    // На время обхода меняет правые указатели: не потокобезопасен, хотя и const
+    template <typename Visit>
+    void visitPostOrder(Visit visit) const;
     std::vector<T> postOrder() const;
-    std::vector<T> countNodesAtEachLevel(TreeNode* root) const;
+    // false, если в дереве нет поддерева по пути options.path.
+    // Вид Sideways без maxDepth идёт по Моррису и временно меняет левые указатели:
+    // одновременно с другими обходами этого дерева вызывать нельзя, хотя метод и const
+    bool render(OutputBuffer& out, const RenderOptions& options = RenderOptions()) const;
+    // Вывод в stdout: print — сверху вниз, printSecond — боком (через render,
+    // с теми же ограничениями)
     void print() const;
     void printSecond();
 };
 
-template <typename T>
-BinaryTree<T>::TreeNode::TreeNode(const T& val)
+template <typename T, template <typename> class NodeAllocator>
+BinaryTree<T, NodeAllocator>::TreeNode::TreeNode(const T& val)
     : value(val), left(nullptr), right(nullptr) {}
 
-template <typename T>
-BinaryTree<T>::BinaryTree() : root(nullptr) {}
+template <typename T, template <typename> class NodeAllocator>
+BinaryTree<T, NodeAllocator>::Builder::Builder(NodeAllocator<TreeNode>& allocator)
+    : allocator(allocator), root(nullptr) {}
 
-template <typename T>
-BinaryTree<T>::~BinaryTree() 
+template <typename T, template <typename> class NodeAllocator>
+void BinaryTree<T, NodeAllocator>::Builder::onNode(const T& value)
 {
-    deleteTree(root);
+    TreeNode* newNode = allocator.create(value);
+
+    if (nodeStack.empty()) {
+        root = newNode;
+    }
+    else {
+        TreeNode* parent = nodeStack.back();
+        if (!parent->left) {
+            parent->left = newNode;
+        }
+        else {
+            parent->right = newNode;
+        }
+    }
+    nodeStack.push_back(newNode);
+}
+
+template <typename T, template <typename> class NodeAllocator>
+void BinaryTree<T, NodeAllocator>::Builder::onClose()
+{
+    nodeStack.pop_back();
 }
 
-template <typename T>
-bool BinaryTree<T>::empty() const 
+template <typename T, template <typename> class NodeAllocator>
+BinaryTree<T, NodeAllocator>::StitchBuilder::StitchBuilder(NodeAllocator<TreeNode>& allocator)
+    : builder(allocator), placeholderNext(false) {}
+
+template <typename T, template <typename> class NodeAllocator>
+void BinaryTree<T, NodeAllocator>::StitchBuilder::onNode(const T& value)
+{
+    builder.onNode(value);
+    if (!placeholderNext) return;
+
+    TreeNode* placeholder = builder.nodeStack.back();
+    if (builder.nodeStack.size() == 1) {
+        slots.push_back(&builder.root);
+    }
+    else {
+        TreeNode* parent = builder.nodeStack[builder.nodeStack.size() - 2];
+        slots.push_back(parent->right == placeholder ? &parent->right : &parent->left);
+    }
+    placeholders.push_back(placeholder);
+    placeholderNext = false;
+}
+
+template <typename T, template <typename> class NodeAllocator>
+void BinaryTree<T, NodeAllocator>::StitchBuilder::onClose()
+{
+    builder.onClose();
+}
+
+template <typename T, template <typename> class NodeAllocator>
+BinaryTree<T, NodeAllocator>::BinaryTree() : root(nullptr) {}
+
+template <typename T, template <typename> class NodeAllocator>
+BinaryTree<T, NodeAllocator>::~BinaryTree() 
+{
+    clear();
+}
+
+template <typename T, template <typename> class NodeAllocator>
+bool BinaryTree<T, NodeAllocator>::empty() const 
 {
     return root == nullptr;
 }
 
-template <typename T>
-void BinaryTree<T>::deleteTree(const TreeNode* node) const {
-    if (!node) return;
-    deleteTree(node->left);
-    deleteTree(node->right);
-    delete node;
+template <typename T, template <typename> class NodeAllocator>
+void BinaryTree<T, NodeAllocator>::clear()
+{
+    releaseTree(root, allocator);
+    root = nullptr;
 }
 
-template <typename T>
-int BinaryTree<T>::getHeight(const TreeNode* root) const {
-    if (root == nullptr) {
-        return 0;
+template <typename T, template <typename> class NodeAllocator>
+void BinaryTree<T, NodeAllocator>::releaseTree(TreeNode* node, NodeAllocator<TreeNode>& from)
+{
+    // Пул освобождает все узлы блоками, без обхода дерева
+    if (NodeAllocator<TreeNode>::releasesInBulk && std::is_trivially_destructible<T>::value) {
+        from.release();
+    }
+    else {
+        destroySubtree(node, from);
+        from.release();
     }
-
-    return 1 + max(getHeight(root->left), getHeight(root->right));
 }
 
-template <typename T>
-void BinaryTree<T>::build(const std::string& str) 
+// Без рекурсии: левые поддеревья поворотами перекладываются в правую цепочку,
+// узлы без левого ребёнка сразу освобождаются
+template <typename T, template <typename> class NodeAllocator>
+void BinaryTree<T, NodeAllocator>::destroySubtree(TreeNode* node, NodeAllocator<TreeNode>& from)
 {
-    deleteTree(root);
-    std::stack<TreeNode*> nodeStack;
-    
-    for (size_t i = 0; i < str.size(); i++) {
-        char ch = str[i];
-        if (std::isspace(ch)) {
-            continue;
+    while (node) {
+        if (node->left) {
+            TreeNode* leftChild = node->left;
+            node->left = leftChild->right;
+            leftChild->right = node;
+            node = leftChild;
         }
-
-        if (ch == '(') {
-            continue;
+        else {
+            TreeNode* next = node->right;
+            from.destroy(node);
+            node = next;
         }
+    }
+}
 
-        if (ch == ')') {
-            if (!nodeStack.empty()) {
-                nodeStack.pop();
-            }
+template <typename T, template <typename> class NodeAllocator>
+void BinaryTree<T, NodeAllocator>::deleteTree(TreeNode* node) {
+    destroySubtree(node, allocator);
+}
+
+template <typename T, template <typename> class NodeAllocator>
+int BinaryTree<T, NodeAllocator>::getHeight() const
+{
+    return getHeight(root);
+}
+
+template <typename T, template <typename> class NodeAllocator>
+int BinaryTree<T, NodeAllocator>::getHeight(const TreeNode* root) const {
+    int height = 0;
+
+    // Обход временно прошивает дерево и восстанавливает его к концу
+    reverseInOrder(const_cast<TreeNode*>(root), 0, false, [&height](const TreeNode*, int level, bool) {
+        height = std::max(height, level + 1);
+    });
+
+    return height;
+}
+
+// Нить — временная ссылка из левого указателя на узел, к которому обход должен вернуться.
+// Младший бит отличает её от настоящего ребёнка, следующий хранит, правым ли ребёнком был узел
+template <typename T, template <typename> class NodeAllocator>
+typename BinaryTree<T, NodeAllocator>::TreeNode* BinaryTree<T, NodeAllocator>::makeThread(TreeNode* target, bool isRight)
+{
+    static_assert(alignof(TreeNode) >= 4, "two low pointer bits are used as thread tags");
+    return reinterpret_cast<TreeNode*>(reinterpret_cast<std::uintptr_t>(target) | 1 | (isRight ? 2 : 0));
+}
+
+template <typename T, template <typename> class NodeAllocator>
+bool BinaryTree<T, NodeAllocator>::isThread(const TreeNode* link)
+{
+    return (reinterpret_cast<std::uintptr_t>(link) & 1) != 0;
+}
+
+template <typename T, template <typename> class NodeAllocator>
+typename BinaryTree<T, NodeAllocator>::TreeNode* BinaryTree<T, NodeAllocator>::threadTarget(TreeNode* link)
+{
+    return reinterpret_cast<TreeNode*>(reinterpret_cast<std::uintptr_t>(link) & ~std::uintptr_t(3));
+}
+
+template <typename T, template <typename> class NodeAllocator>
+bool BinaryTree<T, NodeAllocator>::threadIsRight(const TreeNode* link)
+{
+    return (reinterpret_cast<std::uintptr_t>(link) & 2) != 0;
+}
+
+// Обратный симметричный обход (правое поддерево, узел, левое) по Моррису:
+// без рекурсии и без стека, поэтому глубина дерева ничем не ограничена.
+// visit(node, level, isRight) получает глубину узла и то, правый ли он ребёнок
+template <typename T, template <typename> class NodeAllocator>
+template <typename Visit>
+void BinaryTree<T, NodeAllocator>::reverseInOrder(TreeNode* start, int level, bool isRight, Visit visit) const
+{
+    TreeNode* current = start;
+
+    while (current) {
+        if (!current->right) {
+            visit(current, level, isRight);
         }
-        
-        else if (std::isdigit(str[i]) || (str[i] == '-' && (i + 1) < str.size() && std::isdigit(str[i + 1]))) {
-            int start = i;
-            if (str[i] == '-') {
-                i++;
-            }
-            while (i < str.size() && std::isdigit(str[i])) {
-                i++;
+        else {
+            TreeNode* predecessor = current->right;
+            int steps = 0;
+            while (predecessor->left && threadTarget(predecessor->left) != current) {
+                predecessor = predecessor->left;
+                steps++;
             }
-            
-            T value = std::stoi(str.substr(start, i - start));
-            i--;
-            TreeNode* newNode = new TreeNode(value);
 
-            if (nodeStack.empty()) {
-                root = newNode;
-            }
-            else {
-                TreeNode* parent = nodeStack.top();
-                if (!parent->left) {
-                    parent->left = newNode;
-                }
-                else if (!parent->right) {
-                    parent->right = newNode;
-                }
+            if (!predecessor->left) {
+                predecessor->left = makeThread(current, isRight);
+                current = current->right;
+                level++;
+                isRight = true;
+                continue;
             }
-            nodeStack.push(newNode);
+
+            // Вернулись по нити: правое поддерево пройдено
+            isRight = threadIsRight(predecessor->left);
+            predecessor->left = nullptr;
+            level -= steps + 1;
+            visit(current, level, isRight);
+        }
+
+        TreeNode* next = current->left;
+        if (isThread(next)) {
+            // Глубина поправится, когда нить будет снята
+            current = threadTarget(next);
+        }
+        else {
+            current = next;
+            level++;
+            isRight = false;
         }
     }
 }
 
-template <typename T>
-void BinaryTree<T>::postOrderTraversal(TreeNode* root, std::vector<T>& res) const {
-    if (!root) return ;
-    postOrderTraversal(root->left, res);
-    postOrderTraversal(root->right, res);
-    res.push_back(root->value);
+// Новое дерево строится в отдельном аллокаторе: при ошибке разбора
+// старое дерево остаётся нетронутым
+template <typename T, template <typename> class NodeAllocator>
+void BinaryTree<T, NodeAllocator>::commitBuild(TreeNode* newRoot, NodeAllocator<TreeNode>& newAllocator, const ParseResult& result)
+{
+    if (!result.ok()) {
+        releaseTree(newRoot, newAllocator);
+        return;
+    }
+
+    adoptTree(newRoot, newAllocator);
 }
 
-template <typename T>
-std::vector<T> BinaryTree<T>::postOrder() const {
-    std::vector<T> res;
-    postOrderTraversal(root, res);
-    return res;
+template <typename T, template <typename> class NodeAllocator>
+void BinaryTree<T, NodeAllocator>::adoptTree(TreeNode* newRoot, NodeAllocator<TreeNode>& newAllocator)
+{
+    clear();
+    allocator.swap(newAllocator);
+    root = newRoot;
 }
 
-template <typename T>
-std::vector<T> BinaryTree<T>::countNodesAtEachLevel(TreeNode* root) const 
+template <typename T, template <typename> class NodeAllocator>
+ParseResult BinaryTree<T, NodeAllocator>::build(const std::string& str)
 {
-    std::vector<T> result;
+    return build(str.data(), str.size());
+}
 
-    if (!root) return result;
+template <typename T, template <typename> class NodeAllocator>
+ParseResult BinaryTree<T, NodeAllocator>::build(const char* data, size_t size)
+{
+    NodeAllocator<TreeNode> newAllocator;
+    Builder builder(newAllocator);
+    ParseResult result = BracketParser<T, Builder>::parse(data, size, builder);
+    commitBuild(builder.root, newAllocator, result);
+    return result;
+}
 
-    std::queue<TreeNode*> q;
-    q.push(root);
+template <typename T, template <typename> class NodeAllocator>
+ParseResult BinaryTree<T, NodeAllocator>::build(std::istream& input)
+{
+    NodeAllocator<TreeNode> newAllocator;
+    Builder builder(newAllocator);
+    ParseResult result = BracketParser<T, Builder>::parse(input, builder);
+    commitBuild(builder.root, newAllocator, result);
+    return result;
+}
 
-    while (!q.empty()) {
-        int levelSize = q.size();
-        result.push_back(levelSize);
+template <typename T, template <typename> class NodeAllocator>
+ParseResult BinaryTree<T, NodeAllocator>::buildParallel(const std::string& str, ThreadPool& pool)
+{
+    return buildParallel(str.data(), str.size(), pool);
+}
+
+// Параллельный разбор большого буфера. Дерево получается тем же, что и у build:
+// 1. по кускам буфера параллельно считается баланс скобок, префиксные суммы
+//    дают глубину в начале каждого куска;
+// 2. параллельно собираются скобки верхних maxSplitDepth уровней и выбирается глубина,
+//    на которой поддеревьев достаточно, чтобы занять все потоки;
+// 3. поддеревья этой глубины разбираются в потоках, каждый в свой аллокатор;
+// 4. верхние уровни разбираются последовательно с заглушками на месте поддеревьев,
+//    заглушки заменяются готовыми поддеревьями, аллокаторы потоков сливаются в один.
+// Если вход некорректен или дерево не делится (например, цепочка), разбор идёт
+// последовательно — так и сообщение об ошибке совпадает с build
+template <typename T, template <typename> class NodeAllocator>
+ParseResult BinaryTree<T, NodeAllocator>::buildParallel(const char* data, size_t size, ThreadPool& pool)
+{
+    size_t threads = pool.concurrency();
+    if (size < minParallelBytes || threads < 2) {
+        return build(data, size);
+    }
+
+    // 1. Баланс скобок по кускам
+    size_t chunkCount = threads * 4;
+    size_t chunkSize = (size + chunkCount - 1) / chunkCount;
+    std::vector<long long> chunkDepth(chunkCount + 1, 0);
+    pool.parallelFor(chunkCount, [&](size_t chunk) {
+        const char* first = data + std::min(size, chunk * chunkSize);
+        const char* last = data + std::min(size, (chunk + 1) * chunkSize);
+        long long balance = 0;
+        for (const char* current = first; current != last; current++) {
+            balance += (*current == '(') - (*current == ')');
+        }
+        chunkDepth[chunk + 1] = balance;
+    });
+    for (size_t chunk = 0; chunk < chunkCount; chunk++) {
+        chunkDepth[chunk + 1] += chunkDepth[chunk];
+    }
+    if (chunkDepth[chunkCount] != 0) {
+        return build(data, size);
+    }
+
+    // 2. Скобки верхних уровней
+    std::vector<std::vector<BracketEvent>> chunkEvents(chunkCount);
+    std::vector<char> chunkBroken(chunkCount, 0);
+    pool.parallelFor(chunkCount, [&](size_t chunk) {
+        size_t first = std::min(size, chunk * chunkSize);
+        size_t last = std::min(size, (chunk + 1) * chunkSize);
+        long long depth = chunkDepth[chunk];
+        for (size_t offset = first; offset < last; offset++) {
+            if (data[offset] == '(') {
+                if (depth <= maxSplitDepth) chunkEvents[chunk].push_back({ offset, static_cast<int>(depth), true });
+                depth++;
+            }
+            else if (data[offset] == ')') {
+                depth--;
+                if (depth < 0) chunkBroken[chunk] = 1;
+                else if (depth <= maxSplitDepth) chunkEvents[chunk].push_back({ offset, static_cast<int>(depth), false });
+            }
+        }
+    });
+    if (std::find(chunkBroken.begin(), chunkBroken.end(), 1) != chunkBroken.end()) {
+        return build(data, size);
+    }
 
-        for (int i = 0; i < levelSize; ++i) {
-            TreeNode* node = q.front();
-            q.pop();
+    std::vector<BracketEvent> events;
+    std::vector<size_t> nodesAtDepth(maxSplitDepth + 1, 0);
+    for (const std::vector<BracketEvent>& chunk : chunkEvents) {
+        for (const BracketEvent& event : chunk) {
+            events.push_back(event);
+            if (event.isOpen) nodesAtDepth[event.depth]++;
+        }
+    }
 
-            if (node->left) q.push(node->left);
-            if (node->right) q.push(node->right);
+    int splitDepth = 0;
+    for (int depth = 1; depth <= maxSplitDepth; depth++) {
+        if (nodesAtDepth[depth] > nodesAtDepth[splitDepth]) splitDepth = depth;
+        if (nodesAtDepth[depth] >= threads * 8) break;
+    }
+    if (nodesAtDepth[splitDepth] < 2) {
+        return build(data, size);
+    }
+
+    // Поддеревья глубины splitDepth: от открывающей скобки до парной закрывающей
+    std::vector<std::pair<size_t, size_t>> units;
+    size_t openedAt = 0;
+    for (const BracketEvent& event : events) {
+        if (event.depth != splitDepth) continue;
+        if (event.isOpen) openedAt = event.offset;
+        else units.push_back(std::make_pair(openedAt, event.offset + 1));
+    }
+
+    // 3. Поддеревья разбираются группами примерно равного объёма
+    size_t groupBytes = size / (threads * 4) + 1;
+    std::vector<size_t> groupStart(1, 0);
+    size_t bytesInGroup = 0;
+    for (size_t unit = 0; unit < units.size(); unit++) {
+        if (bytesInGroup >= groupBytes) {
+            groupStart.push_back(unit);
+            bytesInGroup = 0;
+        }
+        bytesInGroup += units[unit].second - units[unit].first;
+    }
+    groupStart.push_back(units.size());
+
+    size_t groupCount = groupStart.size() - 1;
+    std::vector<std::unique_ptr<NodeAllocator<TreeNode>>> groupAllocators(groupCount);
+    std::vector<TreeNode*> unitRoots(units.size(), nullptr);
+    std::vector<char> groupFailed(groupCount, 0);
+    pool.parallelFor(groupCount, [&](size_t group) {
+        groupAllocators[group].reset(new NodeAllocator<TreeNode>());
+        for (size_t unit = groupStart[group]; unit < groupStart[group + 1]; unit++) {
+            Builder builder(*groupAllocators[group]);
+            ParseResult result = BracketParser<T, Builder>::parse(data + units[unit].first, units[unit].second - units[unit].first, builder);
+            unitRoots[unit] = builder.root;
+            if (!result.ok()) {
+                groupFailed[group] = 1;
+                return;
+            }
+        }
+    });
+
+    // 4. Верхние уровни с заглушками
+    NodeAllocator<TreeNode> newAllocator;
+    StitchBuilder stitch(newAllocator);
+    BracketParser<T, StitchBuilder> parser(stitch);
+    bool parsed = std::find(groupFailed.begin(), groupFailed.end(), 1) == groupFailed.end();
+    size_t position = 0;
+    for (size_t unit = 0; parsed && unit < units.size(); unit++) {
+        // "(" отдельно: число перед ним, оставшееся в буфере разборщика, должно стать узлом раньше заглушки
+        parsed = parser.feed(data + position, units[unit].first - position) && parser.feed("(", 1);
+        stitch.placeholderNext = true;
+        parsed = parsed && parser.feed("0)", 2);
+        position = units[unit].second;
+    }
+    parsed = parsed && parser.feed(data + position, size - position) && parser.finish();
+
+    if (!parsed || stitch.placeholders.size() != units.size()) {
+        // В одном аллокаторе потока лежат несколько поддеревьев: сначала обходятся все,
+        // потом память освобождается один раз
+        bool walk = !(NodeAllocator<TreeNode>::releasesInBulk && std::is_trivially_destructible<T>::value);
+        for (size_t group = 0; group < groupCount; group++) {
+            if (!groupAllocators[group]) continue;
+            for (size_t unit = groupStart[group]; walk && unit < groupStart[group + 1]; unit++) {
+                destroySubtree(unitRoots[unit], *groupAllocators[group]);
+            }
+            groupAllocators[group]->release();
         }
+        releaseTree(stitch.builder.root, newAllocator);
+        return build(data, size);
     }
 
+    for (size_t unit = 0; unit < units.size(); unit++) {
+        *stitch.slots[unit] = unitRoots[unit];
+        newAllocator.destroy(stitch.placeholders[unit]);
+    }
+    for (size_t group = 0; group < groupCount; group++) {
+        newAllocator.splice(*groupAllocators[group]);
+    }
+
+    ParseResult result;
+    commitBuild(stitch.builder.root, newAllocator, result);
     return result;
 }
 
-template <typename T>
-void BinaryTree<T>::print() const {
-    if (root == nullptr) {
-        return;
+// Правая цепочка от node посещается с конца: ссылки разворачиваются,
+// а на обратном проходе по развёрнутой цепочке возвращаются на место
+template <typename T, template <typename> class NodeAllocator>
+template <typename Visit>
+void BinaryTree<T, NodeAllocator>::visitReversed(TreeNode* node, Visit& visit)
+{
+    TreeNode* reversed = nullptr;
+    while (node) {
+        TreeNode* next = node->right;
+        node->right = reversed;
+        reversed = node;
+        node = next;
+    }
+
+    while (reversed) {
+        visit(reversed->value);
+        TreeNode* next = reversed->right;
+        reversed->right = node;
+        node = reversed;
+        reversed = next;
     }
+}
 
-    int minSpace = 2;
-    int countSpace = minSpace * std::pow(2, getHeight(root) - 2);
+// Post-order по Моррису: нити в правых указателях, при возврате по нити
+// правая цепочка левого поддерева выводится в обратном порядке
+template <typename T, template <typename> class NodeAllocator>
+template <typename Visit>
+void BinaryTree<T, NodeAllocator>::visitPostOrder(Visit visit) const
+{
+    TreeNode* current = root;
 
-    std::string connector(countSpace, '-');
-    std::string emptySpace(countSpace, ' ');
+    while (current) {
+        if (!current->left) {
+            current = current->right;
+            continue;
+        }
 
-    std::vector<T> transferPoints = countNodesAtEachLevel(root);
-    int transferIndex = 0;
-    int currentIndex = 0;
+        TreeNode* predecessor = current->left;
+        while (predecessor->right && predecessor->right != current) {
+            predecessor = predecessor->right;
+        }
 
-    std::queue<TreeNode*> unprinted;
-    std::queue<int> places{};
-    places.push(1);
+        if (!predecessor->right) {
+            predecessor->right = current;
+            current = current->left;
+        }
+        else {
+            predecessor->right = nullptr;
+            visitReversed(current->left, visit);
+            current = current->right;
+        }
+    }
 
-    int lastPos = 0;
-    unprinted.push(root);
-    while (!unprinted.empty())
-    {
-        TreeNode* current = unprinted.front();
-        currentIndex++;
-        unprinted.pop();
+    visitReversed(root, visit);
+}
 
-        std::string emptySpace(countSpace * (4 * (places.front() - lastPos) - 2) - (lastPos == 0 ? countSpace : 0), ' '); // 2 6 11 14-15 18-19
-        std::string microSpace(countSpace, ' ');
-        std::string connector(countSpace, '-');
+// Прямой обход по Моррису: нити — помеченные указатели в правых ссылках,
+// поэтому visit(value, hasLeft, hasRight) видит настоящих детей узла
+template <typename T, template <typename> class NodeAllocator>
+template <typename Visit>
+void BinaryTree<T, NodeAllocator>::visitPreOrder(Visit visit) const
+{
+    TreeNode* current = root;
 
-        std::cout << emptySpace;
-        if (current->left != nullptr) {
-            std::cout << connector;
-            unprinted.push(current->left);
-            places.push(places.front() * 2 - 1);
+    while (current) {
+        if (!current->left) {
+            visit(current->value, false, current->right && !isThread(current->right));
+            current = threadTarget(current->right);
+            continue;
         }
-        else {
-            std::cout << microSpace;
+
+        TreeNode* predecessor = current->left;
+        while (predecessor->right && !isThread(predecessor->right)) {
+            predecessor = predecessor->right;
         }
-        std::cout << current->value;
-        if (current->right != nullptr) {
-            std::cout << connector;
-            unprinted.push(current->right);
-            places.push(places.front() * 2);
+
+        if (!predecessor->right) {
+            visit(current->value, true, current->right && !isThread(current->right));
+            predecessor->right = makeThread(current, false);
+            current = current->left;
         }
         else {
-            std::cout << microSpace;
+            // Вернулись по нити: левое поддерево пройдено
+            predecessor->right = nullptr;
+            current = threadTarget(current->right);
         }
+    }
+}
+
+template <typename T, template <typename> class NodeAllocator>
+size_t BinaryTree<T, NodeAllocator>::countNodes() const
+{
+    size_t count = 0;
+    visitPreOrder([&count](const T&, bool, bool) {
+        count++;
+    });
+    return count;
+}
+
+template <typename T, template <typename> class NodeAllocator>
+template <typename Walk>
+void BinaryTree<T, NodeAllocator>::walkForSave(Walk emit) const
+{
+    visitPreOrder([&emit](const T& value, bool hasLeft, bool hasRight) {
+        emit(hasLeft, hasRight, false, value);
+    });
+}
+
+template <typename T, template <typename> class NodeAllocator>
+FormatError BinaryTree<T, NodeAllocator>::save(std::ostream& out) const
+{
+    return TreeFormat<T>::save(out, TreeKind::Binary, countNodes(), [this](auto emit) { walkForSave(emit); });
+}
 
-        lastPos = places.front();
-        places.pop();
+template <typename T, template <typename> class NodeAllocator>
+void BinaryTree<T, NodeAllocator>::save(std::vector<char>& buffer) const
+{
+    TreeFormat<T>::save(buffer, TreeKind::Binary, countNodes(), [this](auto emit) { walkForSave(emit); });
+}
 
-        if (transferIndex < transferPoints.size() && currentIndex >= transferPoints[transferIndex]) {
-            transferIndex++;
-            currentIndex = 0;
-            lastPos = 0;
-            countSpace = max(countSpace / 2, 1);
-            std::cout << '\n';
+template <typename T, template <typename> class NodeAllocator>
+FormatError BinaryTree<T, NodeAllocator>::saveFile(const std::string& path) const
+{
+    return TreeFormat<T>::saveFile(path, TreeKind::Binary, countNodes(), [this](auto emit) { walkForSave(emit); });
+}
+
+// Узлы восстанавливаются в прямом порядке: стек хранит свободные места для следующих,
+// сверху — левое место последнего узла. Как и build, при ошибке дерево не меняется
+template <typename T, template <typename> class NodeAllocator>
+FormatError BinaryTree<T, NodeAllocator>::load(const char* data, size_t size)
+{
+    typename TreeFormat<T>::Layout layout;
+    FormatError error = TreeFormat<T>::open(data, size, TreeKind::Binary, layout);
+    if (error != FormatError::None) return error;
+
+    const char* structure = data + layout.structure;
+    const char* values = data + layout.values;
+
+    NodeAllocator<TreeNode> newAllocator;
+    TreeNode* newRoot = nullptr;
+    std::vector<TreeNode**> slots;
+    if (layout.count) slots.push_back(&newRoot);
+
+    for (uint64_t i = 0; i < layout.count; i++) {
+        if (slots.empty()) {
+            error = FormatError::CorruptStructure;
+            break;
         }
+
+        TreeNode* node = newAllocator.create(TreeFormat<T>::value(values, i));
+        *slots.back() = node;
+        slots.pop_back();
+        if (TreeFormat<T>::bit(structure, 2 * i + 1)) slots.push_back(&node->right);
+        if (TreeFormat<T>::bit(structure, 2 * i)) slots.push_back(&node->left);
     }
+    if (!slots.empty()) {
+        error = FormatError::CorruptStructure;
+    }
+
+    if (error != FormatError::None) {
+        releaseTree(newRoot, newAllocator);
+        return error;
+    }
+
+    adoptTree(newRoot, newAllocator);
+    return FormatError::None;
 }
 
-template <typename T>
-void BinaryTree<T>::printSecond(TreeNode* root, int level, bool isRight) const
+template <typename T, template <typename> class NodeAllocator>
+FormatError BinaryTree<T, NodeAllocator>::load(std::istream& input)
 {
-    if (root == NULL) return;
-    printSecond(root->right, level + 1, true);
+    std::vector<char> buffer;
+    FormatError error = TreeFormat<T>::readAll(input, buffer);
+    if (error != FormatError::None) return error;
+    return load(buffer.data(), buffer.size());
+}
 
-    if (!level) std::cout << "-->"; // марафет для корня дерева
-    else std::cout << "   ";
+template <typename T, template <typename> class NodeAllocator>
+FormatError BinaryTree<T, NodeAllocator>::loadFile(const std::string& path)
+{
+    return TreeFormat<T>::loadFile(path, [this](const char* data, size_t size) {
+        return load(data, size);
+    });
+}
 
-    for (int i = 0; i < level; i++) {
-        if (i + 1 == level) isRight ? std::cout << ".-->" : std::cout << "`-->";
-        else std::cout << "    ";
-    }
+template <typename T, template <typename> class NodeAllocator>
+std::vector<T> BinaryTree<T, NodeAllocator>::postOrder() const {
+    std::vector<T> res;
+    visitPostOrder([&res](const T& value) { res.push_back(value); });
+    return res;
+}
 
-    std::cout << root->value << "\n";
+template <typename T, template <typename> class NodeAllocator>
+bool BinaryTree<T, NodeAllocator>::render(OutputBuffer& out, const RenderOptions& options) const
+{
+    return renderFrom(root, out, options);
+}
+
+// Без ограничения глубины боковой вид идёт обходом самого дерева, которому не нужен стек
+template <typename T, template <typename> class NodeAllocator>
+bool BinaryTree<T, NodeAllocator>::renderFrom(const TreeNode* node, OutputBuffer& out, const RenderOptions& options) const
+{
+    typedef TreeRenderer<TreeNode> Renderer;
+
+    const TreeNode* start = Renderer::descend(node, options.path);
+    if (!start) return !node && options.path.empty();
 
-    printSecond(root->left, level + 1);
+    Renderer renderer(out, options);
+    if (options.layout == TreeLayout::TopDown) {
+        renderer.topDown(start);
+    }
+    else if (options.maxDepth >= 0) {
+        renderer.sideways(start);
+    }
+    else {
+        reverseInOrder(const_cast<TreeNode*>(start), 0, false, [&renderer](const TreeNode* node, int level, bool isRight) {
+            renderer.line(node, level, isRight);
+        });
+    }
+    return true;
+}
+
+// Всё, что было выведено через std::cout, уходит раньше дерева
+template <typename T, template <typename> class NodeAllocator>
+void BinaryTree<T, NodeAllocator>::print() const
+{
+    std::cout.flush();
+    OutputBuffer out;
+    RenderOptions options;
+    options.layout = TreeLayout::TopDown;
+    // Полный вывод, как прежде: уровни не сокращаются
+    options.maxLevelWidth = SIZE_MAX;
+    render(out, options);
 }
 
-template <typename T>
-void BinaryTree<T>::printSecond()
+template <typename T, template <typename> class NodeAllocator>
+void BinaryTree<T, NodeAllocator>::printSecond()
 {
-    printSecond(root, 0, false);
+    std::cout.flush();
+    OutputBuffer out;
+    render(out);
 }
 
 #endif // BINARYTREE_H
@@ -0,0 +1,340 @@
+﻿#ifndef BRACKETPARSER_H
+#define BRACKETPARSER_H
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdlib>
+#include <istream>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+enum class ParseError {
+    None,
+    DoubleOpenBracket,
+    UnexpectedCloseBracket,
+    EmptyBrackets,
+    TooManyChildren,
+    NumberOutsideBrackets,
+    InvalidCharacter,
+    InvalidNumber,
+    MultipleRoots,
+    UnclosedBrackets,
+    ReadFailure
+};
+
+struct ParseResult {
+    ParseError error;
+    size_t offset;  // смещение в байтах от начала входа
+    char symbol;    // символ, на котором произошла ошибка
+
+    ParseResult() : error(ParseError::None), offset(0), symbol(0) {}
+    bool ok() const { return error == ParseError::None; }
+};
+
+// Синтаксис и разбор чисел выбираются по типу значения на этапе компиляции.
+// starts() — может ли символ начинать число, continues() — продолжает ли ch число после prev,
+// parse() — преобразование без выделения памяти (std::from_chars)
+template <typename T, typename Enable = void>
+struct NumberSyntax;
+
+template <typename T>
+struct NumberSyntax<T, typename std::enable_if<std::is_integral<T>::value>::type> {
+    static bool isDigit(char ch) { return ch >= '0' && ch <= '9'; }
+
+    static bool starts(char ch)
+    {
+        return isDigit(ch) || ch == '-';
+    }
+
+    static bool continues(char, char ch)
+    {
+        return isDigit(ch);
+    }
+
+    static bool parse(const char* first, const char* last, T& value)
+    {
+        std::from_chars_result parsed = std::from_chars(first, last, value);
+        return parsed.ec == std::errc() && parsed.ptr == last;
+    }
+};
+
+// Десятичная и экспоненциальная запись: -12, 3.25, .5, 1e-7, 6.02E+23
+template <typename T>
+struct NumberSyntax<T, typename std::enable_if<std::is_floating_point<T>::value>::type> {
+    static bool isDigit(char ch) { return ch >= '0' && ch <= '9'; }
+
+    static bool starts(char ch)
+    {
+        return isDigit(ch) || ch == '-' || ch == '.';
+    }
+
+    static bool continues(char prev, char ch)
+    {
+        if (isDigit(ch) || ch == '.' || ch == 'e' || ch == 'E') return true;
+        return (ch == '-' || ch == '+') && (prev == 'e' || prev == 'E');
+    }
+
+    static bool parse(const char* first, const char* last, T& value)
+    {
+#if defined(__cpp_lib_to_chars)
+        std::from_chars_result parsed = std::from_chars(first, last, value, std::chars_format::general);
+        return parsed.ec == std::errc() && parsed.ptr == last;
+#else
+        // Стандартная библиотека без from_chars для вещественных: strtod на копии в стеке
+        char buffer[72];
+        size_t length = static_cast<size_t>(last - first);
+        if (length >= sizeof(buffer)) return false;
+        std::copy(first, last, buffer);
+        buffer[length] = '\0';
+        char* parsedEnd = nullptr;
+        long double parsed = std::strtold(buffer, &parsedEnd);
+        value = static_cast<T>(parsed);
+        return parsedEnd == buffer + length;
+#endif
+    }
+};
+
+// Однопроходный потоковый разбор скобочной записи "(8 (9 (5)) (1))".
+// Проверка корректности и построение идут одновременно: для каждого узла
+// вызывается builder.onNode(value), для каждой закрывающей скобки — builder.onClose().
+// Вход подаётся кусками через feed(), числа разбираются на месте через std::from_chars,
+// память ограничена глубиной дерева и коротким буфером для числа на стыке кусков.
+template <typename T, typename Builder>
+class BracketParser {
+    typedef NumberSyntax<T> Syntax;
+
+public:
+    explicit BracketParser(Builder& builder);
+
+    bool feed(const char* data, size_t size);
+    bool finish();
+    const ParseResult& result() const;
+
+    static ParseResult parse(const char* data, size_t size, Builder& builder);
+    static ParseResult parse(std::istream& input, Builder& builder, size_t chunkSize = 1 << 16);
+
+private:
+    // Число длиннее считается некорректным, где бы ни прошли границы кусков входа
+    static const size_t maxTokenLength = 64;
+
+    Builder& builder;
+    std::vector<unsigned char> countInLevels; // значение + потомки на каждом открытом уровне
+    bool isPrevUnclosedBracket;
+    bool hasRoot;
+    size_t consumed;
+
+    char token[maxTokenLength];
+    size_t tokenLength;
+    size_t tokenOffset;
+
+    ParseResult state;
+
+    static bool isSpace(char ch);
+    bool fail(ParseError error, size_t offset, char symbol = 0);
+    bool openBracket(size_t offset);
+    bool closeBracket(size_t offset);
+    bool number(const char* first, const char* last, size_t offset);
+};
+
+template <typename T, typename Builder>
+BracketParser<T, Builder>::BracketParser(Builder& builder)
+    : builder(builder), isPrevUnclosedBracket(false), hasRoot(false), consumed(0), tokenLength(0), tokenOffset(0) {}
+
+template <typename T, typename Builder>
+bool BracketParser<T, Builder>::isSpace(char ch)
+{
+    return ch == ' ' || ch == '\n' || ch == '\r' || ch == '\t' || ch == '\v' || ch == '\f';
+}
+
+template <typename T, typename Builder>
+bool BracketParser<T, Builder>::fail(ParseError error, size_t offset, char symbol)
+{
+    state.error = error;
+    state.offset = offset;
+    state.symbol = symbol;
+    return false;
+}
+
+template <typename T, typename Builder>
+bool BracketParser<T, Builder>::openBracket(size_t offset)
+{
+    if (isPrevUnclosedBracket) {
+        return fail(ParseError::DoubleOpenBracket, offset, '(');
+    }
+    if (countInLevels.empty() && hasRoot) {
+        return fail(ParseError::MultipleRoots, offset, '(');
+    }
+    if (!countInLevels.empty() && countInLevels.back() >= 3) {
+        return fail(ParseError::TooManyChildren, offset, '(');
+    }
+
+    countInLevels.push_back(0);
+    isPrevUnclosedBracket = true;
+    return true;
+}
+
+template <typename T, typename Builder>
+bool BracketParser<T, Builder>::closeBracket(size_t offset)
+{
+    if (countInLevels.empty()) {
+        return fail(ParseError::UnexpectedCloseBracket, offset, ')');
+    }
+    if (countInLevels.back() == 0) {
+        return fail(ParseError::EmptyBrackets, offset, ')');
+    }
+
+    countInLevels.pop_back();
+    if (!countInLevels.empty()) countInLevels.back()++;
+    isPrevUnclosedBracket = false;
+
+    builder.onClose();
+    return true;
+}
+
+template <typename T, typename Builder>
+bool BracketParser<T, Builder>::number(const char* first, const char* last, size_t offset)
+{
+    if (!isPrevUnclosedBracket) {
+        return fail(ParseError::NumberOutsideBrackets, offset, *first);
+    }
+
+    T value;
+    if (static_cast<size_t>(last - first) > maxTokenLength || !Syntax::parse(first, last, value)) {
+        return fail(ParseError::InvalidNumber, offset, *first);
+    }
+
+    countInLevels.back()++;
+    isPrevUnclosedBracket = false;
+    hasRoot = true;
+
+    builder.onNode(value);
+    return true;
+}
+
+template <typename T, typename Builder>
+bool BracketParser<T, Builder>::feed(const char* data, size_t size)
+{
+    if (!state.ok()) return false;
+
+    const char* end = data + size;
+    const char* current = data;
+
+    // Дочитываем число, разрезанное границей предыдущего куска
+    if (tokenLength > 0) {
+        while (current != end && Syntax::continues(token[tokenLength - 1], *current)) {
+            if (tokenLength == maxTokenLength) {
+                return fail(ParseError::InvalidNumber, tokenOffset, token[0]);
+            }
+            token[tokenLength++] = *current++;
+        }
+        if (current == end) {
+            consumed += size;
+            return true;
+        }
+        if (!number(token, token + tokenLength, tokenOffset)) return false;
+        tokenLength = 0;
+    }
+
+    while (current != end) {
+        char ch = *current;
+        size_t offset = consumed + (current - data);
+
+        if (isSpace(ch)) {
+            current++;
+        }
+        else if (ch == '(') {
+            if (!openBracket(offset)) return false;
+            current++;
+        }
+        else if (ch == ')') {
+            if (!closeBracket(offset)) return false;
+            current++;
+        }
+        else if (Syntax::starts(ch)) {
+            const char* first = current++;
+            while (current != end && Syntax::continues(current[-1], *current)) {
+                current++;
+            }
+
+            if (current == end) {
+                // Число может продолжиться в следующем куске
+                tokenLength = current - first;
+                if (tokenLength > maxTokenLength) {
+                    return fail(ParseError::InvalidNumber, offset, ch);
+                }
+                std::copy(first, current, token);
+                tokenOffset = offset;
+                break;
+            }
+
+            if (!number(first, current, offset)) return false;
+        }
+        else {
+            return fail(ParseError::InvalidCharacter, offset, ch);
+        }
+    }
+
+    consumed += size;
+    return true;
+}
+
+template <typename T, typename Builder>
+bool BracketParser<T, Builder>::finish()
+{
+    if (!state.ok()) return false;
+
+    if (tokenLength > 0) {
+        if (!number(token, token + tokenLength, tokenOffset)) return false;
+        tokenLength = 0;
+    }
+
+    if (!countInLevels.empty()) {
+        return fail(ParseError::UnclosedBrackets, consumed);
+    }
+
+    return true;
+}
+
+template <typename T, typename Builder>
+const ParseResult& BracketParser<T, Builder>::result() const
+{
+    return state;
+}
+
+template <typename T, typename Builder>
+ParseResult BracketParser<T, Builder>::parse(const char* data, size_t size, Builder& builder)
+{
+    BracketParser parser(builder);
+    if (parser.feed(data, size)) {
+        parser.finish();
+    }
+    return parser.result();
+}
+
+template <typename T, typename Builder>
+ParseResult BracketParser<T, Builder>::parse(std::istream& input, Builder& builder, size_t chunkSize)
+{
+    BracketParser parser(builder);
+    std::unique_ptr<char[]> buffer(new char[chunkSize]);
+
+    while (input) {
+        input.read(buffer.get(), chunkSize);
+        size_t count = static_cast<size_t>(input.gcount());
+        if (count == 0) break;
+        if (!parser.feed(buffer.get(), count)) {
+            return parser.result();
+        }
+    }
+
+    if (input.bad()) {
+        parser.fail(ParseError::ReadFailure, parser.consumed);
+        return parser.result();
+    }
+
+    parser.finish();
+    return parser.result();
+}
+
+#endif // BRACKETPARSER_H
@@ -0,0 +1,672 @@
+﻿#ifndef COMPACTREDBLACKTREE_H
+#define COMPACTREDBLACKTREE_H
+
+#include "FrozenTree.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+// Красно-чёрное дерево с узлами в массивах (structure of arrays).
+// Вместо указателей — 32-битные индексы, 0 означает пустую ссылку; цвет хранится
+// в старшем бите индекса родителя. Ссылки узла занимают 12 байт, значения лежат
+// отдельным массивом: около 20 байт на узел при T = double против 40 у RedBlackTree.
+// Удалённые ячейки собираются в список свободных и занимаются новыми узлами.
+// Алгоритмы вставки и удаления те же, что в RedBlackTree
+template <typename T>
+class CompactRedBlackTree {
+public:
+    CompactRedBlackTree();
+    explicit CompactRedBlackTree(const std::vector<T>& data);
+
+    bool empty() const;
+    size_t size() const;
+    // Память под узлы в байтах, включая свободные ячейки
+    size_t memoryUsage() const;
+    void clear();
+    void reserve(size_t count);
+    void bulkLoad(const std::vector<T>& data);
+    void insert(const T& value);
+    bool deleteNode(const T& value);
+    bool search(const T& value) const;
+    // Первый элемент, не меньший value, или nullptr
+    const T* lowerBound(const T& value) const;
+    std::vector<T> inOrder() const;
+    std::vector<T> preOrder() const;
+    std::vector<T> postOrder() const;
+    std::vector<T> breadthFirstTraversal() const;
+    int getHeight() const;
+    FrozenTree<T> freeze() const;
+
+private:
+    typedef uint32_t Index;
+
+    struct Links {
+        Index left;
+        Index right;
+        Index parentColor; // индекс родителя, старший бит — красный ли узел
+    };
+
+    static const Index nil = 0;
+    static const Index redBit = Index(1) << 31;
+    // Ячейка 0 занята пустой ссылкой, а индекс родителя не должен задевать бит цвета
+    static const size_t maxNodes = redBit - 1;
+
+    std::vector<Links> links;  // links[0] и values[0] не используются
+    std::vector<T> values;
+    Index root;
+    Index freeList;            // свободные ячейки связаны через left
+    size_t nodeCount;
+
+    Index parent(Index node) const;
+    void setParent(Index node, Index newParent);
+    bool isRed(Index node) const;
+    void setRed(Index node, bool red);
+    Index createNode(const T& value);
+    void destroyNode(Index node);
+    Index find(const T& value) const;
+    Index leftmost(Index node) const;
+    Index successor(Index node) const;
+    Index linkBalanced(Index first, size_t count, Index parentNode, int depth, int redDepth);
+    void rotateLeft(Index pivotNode);
+    void rotateRight(Index pivotNode);
+    void fixInsert(Index currentNode);
+    void transplant(Index u, Index v);
+    void fixDelete(Index x, Index xParent);
+};
+
+template <typename T>
+CompactRedBlackTree<T>::CompactRedBlackTree() : links(1), values(1), root(nil), freeList(nil), nodeCount(0) {}
+
+template <typename T>
+CompactRedBlackTree<T>::CompactRedBlackTree(const std::vector<T>& data)
+    : links(1), values(1), root(nil), freeList(nil), nodeCount(0)
+{
+    bulkLoad(data);
+}
+
+template <typename T>
+bool CompactRedBlackTree<T>::empty() const
+{
+    return root == nil;
+}
+
+template <typename T>
+size_t CompactRedBlackTree<T>::size() const
+{
+    return nodeCount;
+}
+
+template <typename T>
+size_t CompactRedBlackTree<T>::memoryUsage() const
+{
+    return links.capacity() * sizeof(Links) + values.capacity() * sizeof(T);
+}
+
+template <typename T>
+void CompactRedBlackTree<T>::clear()
+{
+    // Как и RedBlackTree::clear, отдаёт память целиком
+    std::vector<Links>(1).swap(links);
+    std::vector<T>(1).swap(values);
+    root = nil;
+    freeList = nil;
+    nodeCount = 0;
+}
+
+template <typename T>
+void CompactRedBlackTree<T>::reserve(size_t count)
+{
+    links.reserve(count + 1);
+    values.reserve(count + 1);
+}
+
+template <typename T>
+typename CompactRedBlackTree<T>::Index CompactRedBlackTree<T>::parent(Index node) const
+{
+    return links[node].parentColor & ~redBit;
+}
+
+template <typename T>
+void CompactRedBlackTree<T>::setParent(Index node, Index newParent)
+{
+    links[node].parentColor = (links[node].parentColor & redBit) | newParent;
+}
+
+// Пустая ссылка считается чёрной
+template <typename T>
+bool CompactRedBlackTree<T>::isRed(Index node) const
+{
+    return node != nil && (links[node].parentColor & redBit) != 0;
+}
+
+template <typename T>
+void CompactRedBlackTree<T>::setRed(Index node, bool red)
+{
+    links[node].parentColor = red ? (links[node].parentColor | redBit) : (links[node].parentColor & ~redBit);
+}
+
+template <typename T>
+typename CompactRedBlackTree<T>::Index CompactRedBlackTree<T>::createNode(const T& value)
+{
+    Index node = freeList;
+    if (node != nil) {
+        freeList = links[node].left;
+        values[node] = value;
+    }
+    else {
+        if (links.size() > maxNodes) {
+            throw std::length_error("CompactRedBlackTree: too many nodes for 32-bit indices");
+        }
+        node = static_cast<Index>(links.size());
+        links.push_back(Links());
+        values.push_back(value);
+    }
+
+    // Новый узел красный, как в RedBlackTree
+    links[node].left = nil;
+    links[node].right = nil;
+    links[node].parentColor = redBit;
+    return node;
+}
+
+template <typename T>
+void CompactRedBlackTree<T>::destroyNode(Index node)
+{
+    links[node].left = freeList;
+    freeList = node;
+}
+
+// Построение за O(n) без поворотов, как RedBlackTree::bulkLoad.
+// Узлы занимают ячейки в порядке возрастания значений, поэтому массив значений отсортирован
+template <typename T>
+void CompactRedBlackTree<T>::bulkLoad(const std::vector<T>& data)
+{
+    clear();
+    if (data.empty()) return;
+    if (data.size() > maxNodes) {
+        throw std::length_error("CompactRedBlackTree: too many nodes for 32-bit indices");
+    }
+
+    values.reserve(data.size() + 1);
+    values.insert(values.end(), data.begin(), data.end());
+    if (!std::is_sorted(values.begin() + 1, values.end())) {
+        std::sort(values.begin() + 1, values.end());
+    }
+    links.resize(data.size() + 1);
+
+    int height = 0;
+    while ((size_t(1) << height) - 1 < data.size()) {
+        height++;
+    }
+
+    int redDepth = ((size_t(1) << height) - 1 == data.size()) ? -1 : height - 1;
+    root = linkBalanced(1, data.size(), nil, 0, redDepth);
+    nodeCount = data.size();
+}
+
+template <typename T>
+typename CompactRedBlackTree<T>::Index CompactRedBlackTree<T>::linkBalanced(Index first, size_t count, Index parentNode, int depth, int redDepth)
+{
+    if (count == 0) return nil;
+
+    size_t middle = count / 2;
+    Index node = first + static_cast<Index>(middle);
+    links[node].parentColor = parentNode | (depth == redDepth ? redBit : 0);
+    links[node].left = linkBalanced(first, middle, node, depth + 1, redDepth);
+    links[node].right = linkBalanced(node + 1, count - middle - 1, node, depth + 1, redDepth);
+
+    return node;
+}
+
+template <typename T>
+void CompactRedBlackTree<T>::rotateLeft(Index pivotNode)
+{
+    Index newParent = links[pivotNode].right;
+    links[pivotNode].right = links[newParent].left;
+
+    if (links[newParent].left) setParent(links[newParent].left, pivotNode);
+
+    Index pivotParent = parent(pivotNode);
+    setParent(newParent, pivotParent);
+
+    if (!pivotParent)
+        root = newParent;
+    else if (pivotNode == links[pivotParent].left)
+        links[pivotParent].left = newParent;
+    else
+        links[pivotParent].right = newParent;
+
+    links[newParent].left = pivotNode;
+    setParent(pivotNode, newParent);
+}
+
+template <typename T>
+void CompactRedBlackTree<T>::rotateRight(Index pivotNode)
+{
+    Index leftChild = links[pivotNode].left;
+    links[pivotNode].left = links[leftChild].right;
+
+    if (links[leftChild].right) setParent(links[leftChild].right, pivotNode);
+
+    Index pivotParent = parent(pivotNode);
+    setParent(leftChild, pivotParent);
+
+    if (!pivotParent)
+        root = leftChild;
+    else if (pivotNode == links[pivotParent].right)
+        links[pivotParent].right = leftChild;
+    else
+        links[pivotParent].left = leftChild;
+
+    links[leftChild].right = pivotNode;
+    setParent(pivotNode, leftChild);
+}
+
+template <typename T>
+void CompactRedBlackTree<T>::fixInsert(Index currentNode)
+{
+    while (currentNode != root && isRed(parent(currentNode))) {
+        Index parentNode = parent(currentNode);
+        Index grandparentNode = parent(parentNode);
+
+        if (parentNode == links[grandparentNode].left) {
+            Index uncleNode = links[grandparentNode].right;
+
+            if (isRed(uncleNode)) {
+                setRed(parentNode, false);
+                setRed(uncleNode, false);
+                setRed(grandparentNode, true);
+                currentNode = grandparentNode;
+            }
+            else {
+                if (currentNode == links[parentNode].right) {
+                    currentNode = parentNode;
+                    rotateLeft(currentNode);
+                    parentNode = parent(currentNode);
+                }
+
+                setRed(parentNode, false);
+                setRed(grandparentNode, true);
+                rotateRight(grandparentNode);
+            }
+        }
+        else {
+            Index uncleNode = links[grandparentNode].left;
+
+            if (isRed(uncleNode)) {
+                setRed(parentNode, false);
+                setRed(uncleNode, false);
+                setRed(grandparentNode, true);
+                currentNode = grandparentNode;
+            }
+            else {
+                if (currentNode == links[parentNode].left) {
+                    currentNode = parentNode;
+                    rotateRight(currentNode);
+                    parentNode = parent(currentNode);
+                }
+
+                setRed(parentNode, false);
+                setRed(grandparentNode, true);
+                rotateLeft(grandparentNode);
+            }
+        }
+    }
+
+    setRed(root, false);
+}
+
+template <typename T>
+void CompactRedBlackTree<T>::insert(const T& value)
+{
+    Index newNode = createNode(value);
+    nodeCount++;
+    if (!root) {
+        root = newNode;
+        setRed(root, false);
+        return;
+    }
+
+    Index current = root;
+    Index parentNode = nil;
+
+    while (current) {
+        parentNode = current;
+        if (value < values[current])
+            current = links[current].left;
+        else
+            current = links[current].right;
+    }
+
+    setParent(newNode, parentNode);
+    if (value < values[parentNode])
+        links[parentNode].left = newNode;
+    else
+        links[parentNode].right = newNode;
+
+    fixInsert(newNode);
+}
+
+template <typename T>
+typename CompactRedBlackTree<T>::Index CompactRedBlackTree<T>::find(const T& value) const
+{
+    Index current = root;
+
+    while (current) {
+        if (value < values[current])
+            current = links[current].left;
+        else if (values[current] < value)
+            current = links[current].right;
+        else
+            return current;
+    }
+
+    return nil;
+}
+
+template <typename T>
+bool CompactRedBlackTree<T>::search(const T& value) const
+{
+    return find(value) != nil;
+}
+
+template <typename T>
+const T* CompactRedBlackTree<T>::lowerBound(const T& value) const
+{
+    Index candidate = nil;
+    Index current = root;
+
+    while (current) {
+        if (values[current] < value) {
+            current = links[current].right;
+        }
+        else {
+            candidate = current;
+            current = links[current].left;
+        }
+    }
+
+    return candidate ? &values[candidate] : nullptr;
+}
+
+template <typename T>
+void CompactRedBlackTree<T>::transplant(Index u, Index v)
+{
+    Index uParent = parent(u);
+    if (!uParent)
+        root = v;
+    else if (u == links[uParent].left)
+        links[uParent].left = v;
+    else
+        links[uParent].right = v;
+
+    if (v)
+        setParent(v, uParent);
+}
+
+template <typename T>
+bool CompactRedBlackTree<T>::deleteNode(const T& value)
+{
+    Index nodeToDelete = find(value);
+    if (!nodeToDelete)
+        return false;
+
+    Index y = nodeToDelete;
+    Index x = nil;
+    Index xParent = nil;
+    bool yOriginalRed = isRed(y);
+
+    if (!links[nodeToDelete].left) {
+        x = links[nodeToDelete].right;
+        xParent = parent(nodeToDelete);
+        transplant(nodeToDelete, links[nodeToDelete].right);
+    }
+    else if (!links[nodeToDelete].right) {
+        x = links[nodeToDelete].left;
+        xParent = parent(nodeToDelete);
+        transplant(nodeToDelete, links[nodeToDelete].left);
+    }
+    else {
+        Index successorNode = leftmost(links[nodeToDelete].right);
+
+        y = successorNode;
+        yOriginalRed = isRed(y);
+        x = links[y].right;
+
+        if (parent(y) == nodeToDelete) {
+            xParent = y;
+            if (x) setParent(x, y);
+        }
+        else {
+            xParent = parent(y);
+            transplant(y, links[y].right);
+            links[y].right = links[nodeToDelete].right;
+            setParent(links[y].right, y);
+        }
+
+        transplant(nodeToDelete, y);
+        links[y].left = links[nodeToDelete].left;
+        setParent(links[y].left, y);
+        setRed(y, isRed(nodeToDelete));
+    }
+
+    nodeCount--;
+    destroyNode(nodeToDelete);
+
+    // x может быть пустым: тогда «двойной чёрный» висит на месте ребёнка xParent
+    if (!yOriginalRed) {
+        fixDelete(x, xParent);
+    }
+
+    return true;
+}
+
+template <typename T>
+void CompactRedBlackTree<T>::fixDelete(Index x, Index xParent)
+{
+    while (x != root && !isRed(x)) {
+        if (x == links[xParent].left) {
+            Index sibling = links[xParent].right;
+            if (isRed(sibling)) {
+                setRed(sibling, false);
+                setRed(xParent, true);
+                rotateLeft(xParent);
+                sibling = links[xParent].right;
+            }
+
+            if (!isRed(links[sibling].left) && !isRed(links[sibling].right)) {
+                setRed(sibling, true);
+                x = xParent;
+                xParent = parent(x);
+            }
+            else {
+                if (!isRed(links[sibling].right)) {
+                    if (links[sibling].left) setRed(links[sibling].left, false);
+                    setRed(sibling, true);
+                    rotateRight(sibling);
+                    sibling = links[xParent].right;
+                }
+                setRed(sibling, isRed(xParent));
+                setRed(xParent, false);
+                if (links[sibling].right) setRed(links[sibling].right, false);
+                rotateLeft(xParent);
+                x = root;
+            }
+        }
+        else {
+            Index sibling = links[xParent].left;
+            if (isRed(sibling)) {
+                setRed(sibling, false);
+                setRed(xParent, true);
+                rotateRight(xParent);
+                sibling = links[xParent].left;
+            }
+
+            if (!isRed(links[sibling].right) && !isRed(links[sibling].left)) {
+                setRed(sibling, true);
+                x = xParent;
+                xParent = parent(x);
+            }
+            else {
+                if (!isRed(links[sibling].left)) {
+                    if (links[sibling].right) setRed(links[sibling].right, false);
+                    setRed(sibling, true);
+                    rotateLeft(sibling);
+                    sibling = links[xParent].left;
+                }
+                setRed(sibling, isRed(xParent));
+                setRed(xParent, false);
+                if (links[sibling].left) setRed(links[sibling].left, false);
+                rotateRight(xParent);
+                x = root;
+            }
+        }
+    }
+
+    if (x) setRed(x, false);
+}
+
+template <typename T>
+typename CompactRedBlackTree<T>::Index CompactRedBlackTree<T>::leftmost(Index node) const
+{
+    while (links[node].left) {
+        node = links[node].left;
+    }
+    return node;
+}
+
+template <typename T>
+typename CompactRedBlackTree<T>::Index CompactRedBlackTree<T>::successor(Index node) const
+{
+    if (links[node].right) return leftmost(links[node].right);
+
+    Index parentNode = parent(node);
+    while (parentNode && node == links[parentNode].right) {
+        node = parentNode;
+        parentNode = parent(node);
+    }
+    return parentNode;
+}
+
+template <typename T>
+std::vector<T> CompactRedBlackTree<T>::inOrder() const
+{
+    std::vector<T> res;
+    res.reserve(nodeCount);
+    if (!root) return res;
+
+    for (Index node = leftmost(root); node; node = successor(node)) {
+        res.push_back(values[node]);
+    }
+    return res;
+}
+
+// Прямой и обратный обходы идут по индексам родителей, как в RedBlackTree
+template <typename T>
+std::vector<T> CompactRedBlackTree<T>::preOrder() const
+{
+    std::vector<T> res;
+    res.reserve(nodeCount);
+
+    Index current = root;
+    while (current) {
+        res.push_back(values[current]);
+
+        if (links[current].left) {
+            current = links[current].left;
+        }
+        else if (links[current].right) {
+            current = links[current].right;
+        }
+        else {
+            // Поднимаемся, пока не найдётся непосещённое правое поддерево
+            Index parentNode = parent(current);
+            while (parentNode && (current == links[parentNode].right || !links[parentNode].right)) {
+                current = parentNode;
+                parentNode = parent(current);
+            }
+            current = parentNode ? links[parentNode].right : nil;
+        }
+    }
+    return res;
+}
+
+template <typename T>
+std::vector<T> CompactRedBlackTree<T>::postOrder() const
+{
+    std::vector<T> res;
+    res.reserve(nodeCount);
+
+    Index current = root;
+    while (current) {
+        while (links[current].left || links[current].right) {
+            current = links[current].left ? links[current].left : links[current].right;
+        }
+
+        while (true) {
+            res.push_back(values[current]);
+
+            Index parentNode = parent(current);
+            if (!parentNode) return res;
+
+            if (current == links[parentNode].left && links[parentNode].right) {
+                current = links[parentNode].right;
+                break;
+            }
+            current = parentNode;
+        }
+    }
+    return res;
+}
+
+template <typename T>
+std::vector<T> CompactRedBlackTree<T>::breadthFirstTraversal() const
+{
+    std::vector<T> res;
+    res.reserve(nodeCount);
+    if (!root) return res;
+
+    std::queue<Index> queue;
+    queue.push(root);
+    while (!queue.empty()) {
+        Index node = queue.front();
+        queue.pop();
+        res.push_back(values[node]);
+
+        if (links[node].left) queue.push(links[node].left);
+        if (links[node].right) queue.push(links[node].right);
+    }
+    return res;
+}
+
+template <typename T>
+int CompactRedBlackTree<T>::getHeight() const
+{
+    if (!root) return 0;
+
+    // Глубина считается по уровням, без рекурсии
+    int height = 0;
+    std::vector<Index> level(1, root);
+    std::vector<Index> next;
+    while (!level.empty()) {
+        height++;
+        next.clear();
+        for (Index node : level) {
+            if (links[node].left) next.push_back(links[node].left);
+            if (links[node].right) next.push_back(links[node].right);
+        }
+        level.swap(next);
+    }
+    return height;
+}
+
+template <typename T>
+FrozenTree<T> CompactRedBlackTree<T>::freeze() const
+{
+    return FrozenTree<T>(inOrder());
+}
+
+#endif // COMPACTREDBLACKTREE_H
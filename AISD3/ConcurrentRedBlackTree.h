@@ -0,0 +1,473 @@
+﻿#ifndef CONCURRENTREDBLACKTREE_H
+#define CONCURRENTREDBLACKTREE_H
+
+#include "RedBlackTree.h"
+#include "EpochAllocator.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Красно-чёрное дерево для одного писателя и многих читателей.
+// Писатели выполняются по очереди под мьютексом и на время изменения делают
+// счётчик версий (seqlock) нечётным. Поиск идёт без блокировок: читатель спускается
+// по дереву, затем сверяет версию и при её изменении повторяет спуск.
+// Удалённые узлы освобождает EpochAllocator, когда на них уже не может смотреть
+// ни один читатель, поэтому спуск по устаревшим указателям не трогает чужую память.
+// Ссылки left, right и root писатель публикует атомарно (RedBlackTree::storeLink),
+// значение узла после публикации не меняется, а parent и color читает только писатель.
+// Обходы так же копируют дерево без блокировок и сверяют версию; size() и empty()
+// читают счётчик, который писатель обновляет в конце изменения.
+template <typename T>
+class ConcurrentRedBlackTree {
+    typedef RedBlackTree<T, EpochAllocator> Tree;
+    typedef typename Tree::TreeNode TreeNode;
+
+public:
+    // Читатель занимает слот эпох на всё время жизни: один объект на поток.
+    // Если свободных слотов нет, читатель ищет под мьютексом
+    class Reader {
+    public:
+        explicit Reader(ConcurrentRedBlackTree& tree);
+        ~Reader();
+
+        Reader(const Reader&) = delete;
+        Reader& operator=(const Reader&) = delete;
+
+        bool contains(const T& value);
+        bool lowerBound(const T& value, T& result);
+        std::vector<T> inOrder();
+        std::vector<T> preOrder();
+        std::vector<T> postOrder();
+        std::vector<T> breadthFirstTraversal();
+
+    private:
+        ConcurrentRedBlackTree& owner;
+        size_t slot;
+    };
+
+    ConcurrentRedBlackTree();
+
+    ConcurrentRedBlackTree(const ConcurrentRedBlackTree&) = delete;
+    ConcurrentRedBlackTree& operator=(const ConcurrentRedBlackTree&) = delete;
+
+    void insert(const T& value);
+    bool deleteNode(const T& value);
+    void bulkLoad(const std::vector<T>& data);
+    void clear();
+
+    size_t size() const;
+    bool empty() const;
+    // Обходы занимают слот читателя на один вызов; для частых обходов и поиска
+    // выгоднее держать в потоке свой Reader
+    std::vector<T> inOrder();
+    std::vector<T> preOrder();
+    std::vector<T> postOrder();
+    std::vector<T> breadthFirstTraversal();
+
+private:
+    // Узел копии дерева: дети — индексы в том же массиве
+    struct SnapshotNode {
+        T value;
+        size_t left;
+        size_t right;
+    };
+
+    // Спуск длиннее этого возможен только по разорванному поворотом дереву
+    static const int maxDescent = 128;
+    // После стольких неудачных попыток читатель ждёт писателя на мьютексе
+    static const int maxOptimisticAttempts = 64;
+    // Копия всего дерева дорога, поэтому при занятом писателе мьютекс берётся раньше
+    static const int maxSnapshotAttempts = 4;
+    // Через столько узлов копирование сверяет версию, чтобы не кружить по разорванному дереву
+    static const size_t validateEvery = 1024;
+    static const size_t noChild = static_cast<size_t>(-1);
+
+    Tree tree;
+    mutable std::mutex writerMutex;
+    std::atomic<uint64_t> sequence;
+    std::atomic<size_t> elements;
+
+    void beginWrite();
+    void endWrite();
+    static const TreeNode* loadLink(TreeNode* const& link);
+    bool optimisticLowerBound(size_t slot, const T& value, bool& found, T* result);
+    bool lockedLowerBound(const T& value, T* result) const;
+    bool readLowerBound(size_t slot, const T& value, T* result);
+    bool copyTree(uint64_t before, std::vector<SnapshotNode>& nodes) const;
+    void readSnapshot(size_t slot, std::vector<SnapshotNode>& nodes);
+    static std::vector<T> inOrder(const std::vector<SnapshotNode>& nodes);
+    static std::vector<T> preOrder(const std::vector<SnapshotNode>& nodes);
+    static std::vector<T> postOrder(const std::vector<SnapshotNode>& nodes);
+    static std::vector<T> breadthFirst(const std::vector<SnapshotNode>& nodes);
+};
+
+template <typename T>
+ConcurrentRedBlackTree<T>::Reader::Reader(ConcurrentRedBlackTree& tree)
+    : owner(tree), slot(tree.tree.allocator.acquireSlot()) {}
+
+template <typename T>
+ConcurrentRedBlackTree<T>::Reader::~Reader()
+{
+    if (slot != EpochAllocator<TreeNode>::noSlot) {
+        owner.tree.allocator.releaseSlot(slot);
+    }
+}
+
+template <typename T>
+bool ConcurrentRedBlackTree<T>::Reader::contains(const T& value)
+{
+    return owner.readLowerBound(slot, value, nullptr);
+}
+
+// result — первый элемент, не меньший value; false, если такого нет
+template <typename T>
+bool ConcurrentRedBlackTree<T>::Reader::lowerBound(const T& value, T& result)
+{
+    return owner.readLowerBound(slot, value, &result);
+}
+
+template <typename T>
+std::vector<T> ConcurrentRedBlackTree<T>::Reader::inOrder()
+{
+    std::vector<SnapshotNode> nodes;
+    owner.readSnapshot(slot, nodes);
+    return ConcurrentRedBlackTree::inOrder(nodes);
+}
+
+template <typename T>
+std::vector<T> ConcurrentRedBlackTree<T>::Reader::preOrder()
+{
+    std::vector<SnapshotNode> nodes;
+    owner.readSnapshot(slot, nodes);
+    return ConcurrentRedBlackTree::preOrder(nodes);
+}
+
+template <typename T>
+std::vector<T> ConcurrentRedBlackTree<T>::Reader::postOrder()
+{
+    std::vector<SnapshotNode> nodes;
+    owner.readSnapshot(slot, nodes);
+    return ConcurrentRedBlackTree::postOrder(nodes);
+}
+
+template <typename T>
+std::vector<T> ConcurrentRedBlackTree<T>::Reader::breadthFirstTraversal()
+{
+    std::vector<SnapshotNode> nodes;
+    owner.readSnapshot(slot, nodes);
+    return ConcurrentRedBlackTree::breadthFirst(nodes);
+}
+
+template <typename T>
+ConcurrentRedBlackTree<T>::ConcurrentRedBlackTree() : sequence(0), elements(0) {}
+
+template <typename T>
+void ConcurrentRedBlackTree<T>::beginWrite()
+{
+    sequence.fetch_add(1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+template <typename T>
+void ConcurrentRedBlackTree<T>::endWrite()
+{
+    elements.store(tree.size(), std::memory_order_relaxed);
+    sequence.fetch_add(1, std::memory_order_release);
+}
+
+template <typename T>
+void ConcurrentRedBlackTree<T>::insert(const T& value)
+{
+    std::lock_guard<std::mutex> lock(writerMutex);
+    beginWrite();
+    tree.insert(value);
+    endWrite();
+}
+
+template <typename T>
+bool ConcurrentRedBlackTree<T>::deleteNode(const T& value)
+{
+    std::lock_guard<std::mutex> lock(writerMutex);
+    if (!tree.search(value)) return false;
+
+    beginWrite();
+    bool deleted = tree.deleteNode(value);
+    endWrite();
+    return deleted;
+}
+
+template <typename T>
+void ConcurrentRedBlackTree<T>::bulkLoad(const std::vector<T>& data)
+{
+    std::lock_guard<std::mutex> lock(writerMutex);
+    beginWrite();
+    tree.bulkLoad(data);
+    endWrite();
+}
+
+template <typename T>
+void ConcurrentRedBlackTree<T>::clear()
+{
+    std::lock_guard<std::mutex> lock(writerMutex);
+    beginWrite();
+    tree.clear();
+    endWrite();
+}
+
+// Чтение ссылки, которую одновременно может менять писатель.
+// Гонка ожидаема: результат спуска проверяется по версии дерева
+template <typename T>
+const typename ConcurrentRedBlackTree<T>::TreeNode* ConcurrentRedBlackTree<T>::loadLink(TreeNode* const& link)
+{
+#if defined(_MSC_VER)
+    const TreeNode* node = *static_cast<TreeNode* const volatile*>(&link);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return node;
+#else
+    return __atomic_load_n(&link, __ATOMIC_ACQUIRE);
+#endif
+}
+
+// Одна попытка спуска без блокировок. false — писатель успел что-то изменить, нужен повтор.
+// С result ищется первый элемент, не меньший value, без него — сам value
+template <typename T>
+bool ConcurrentRedBlackTree<T>::optimisticLowerBound(size_t slot, const T& value, bool& found, T* result)
+{
+    EpochAllocator<TreeNode>& allocator = tree.allocator;
+    allocator.enter(slot);
+
+    uint64_t before = sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+        allocator.leave(slot);
+        return false;
+    }
+
+    const TreeNode* candidate = nullptr;
+    const TreeNode* node = loadLink(tree.root);
+    int depth = 0;
+    while (node && depth < maxDescent) {
+        if (node->value < value) {
+            node = loadLink(node->right);
+        }
+        else {
+            candidate = node;
+            node = loadLink(node->left);
+        }
+        depth++;
+    }
+    // Узлы живы, пока читатель не вышел из эпохи, поэтому сравнение и копия делаются здесь
+    if (result) {
+        found = candidate != nullptr;
+        if (found) *result = candidate->value;
+    }
+    else {
+        found = candidate && !(value < candidate->value);
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    bool valid = !node && sequence.load(std::memory_order_relaxed) == before;
+    allocator.leave(slot);
+    return valid;
+}
+
+template <typename T>
+bool ConcurrentRedBlackTree<T>::lockedLowerBound(const T& value, T* result) const
+{
+    std::lock_guard<std::mutex> lock(writerMutex);
+    typename Tree::const_iterator lower = tree.lower_bound(value);
+    if (lower == tree.end()) return false;
+
+    if (result) {
+        *result = *lower;
+        return true;
+    }
+    return !(value < *lower);
+}
+
+template <typename T>
+bool ConcurrentRedBlackTree<T>::readLowerBound(size_t slot, const T& value, T* result)
+{
+    if (slot != EpochAllocator<TreeNode>::noSlot) {
+        for (int attempt = 0; attempt < maxOptimisticAttempts; attempt++) {
+            bool found;
+            if (optimisticLowerBound(slot, value, found, result)) {
+                return found;
+            }
+            std::this_thread::yield();
+        }
+    }
+    return lockedLowerBound(value, result);
+}
+
+// Копия дерева в прямом порядке. false — версия ушла от before, копия недействительна.
+// Под мьютексом писателя версия не меняется, и копирование всегда удаётся
+template <typename T>
+bool ConcurrentRedBlackTree<T>::copyTree(uint64_t before, std::vector<SnapshotNode>& nodes) const
+{
+    struct Pending {
+        const TreeNode* node;
+        size_t parent;
+        bool isRight;
+    };
+
+    nodes.clear();
+    std::vector<Pending> stack;
+    const TreeNode* start = loadLink(tree.root);
+    if (start) stack.push_back({ start, noChild, false });
+
+    while (!stack.empty()) {
+        // В целом дереве стек не глубже его высоты
+        if (stack.size() > static_cast<size_t>(maxDescent)) return false;
+        if (nodes.size() % validateEvery == validateEvery - 1 && sequence.load(std::memory_order_acquire) != before) {
+            return false;
+        }
+
+        Pending pending = stack.back();
+        stack.pop_back();
+        size_t index = nodes.size();
+        nodes.push_back({ pending.node->value, noChild, noChild });
+        if (pending.parent != noChild) {
+            (pending.isRight ? nodes[pending.parent].right : nodes[pending.parent].left) = index;
+        }
+
+        const TreeNode* right = loadLink(pending.node->right);
+        const TreeNode* left = loadLink(pending.node->left);
+        if (right) stack.push_back({ right, index, true });
+        if (left) stack.push_back({ left, index, false });
+    }
+
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return sequence.load(std::memory_order_relaxed) == before;
+}
+
+template <typename T>
+void ConcurrentRedBlackTree<T>::readSnapshot(size_t slot, std::vector<SnapshotNode>& nodes)
+{
+    if (slot != EpochAllocator<TreeNode>::noSlot) {
+        EpochAllocator<TreeNode>& allocator = tree.allocator;
+        for (int attempt = 0; attempt < maxSnapshotAttempts; attempt++) {
+            allocator.enter(slot);
+            uint64_t before = sequence.load(std::memory_order_acquire);
+            bool valid = !(before & 1) && copyTree(before, nodes);
+            allocator.leave(slot);
+            if (valid) return;
+            std::this_thread::yield();
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(writerMutex);
+    copyTree(sequence.load(std::memory_order_relaxed), nodes);
+}
+
+template <typename T>
+std::vector<T> ConcurrentRedBlackTree<T>::inOrder(const std::vector<SnapshotNode>& nodes)
+{
+    std::vector<T> result;
+    result.reserve(nodes.size());
+    std::vector<size_t> stack;
+    size_t current = nodes.empty() ? noChild : 0;
+    while (current != noChild || !stack.empty()) {
+        while (current != noChild) {
+            stack.push_back(current);
+            current = nodes[current].left;
+        }
+        current = stack.back();
+        stack.pop_back();
+        result.push_back(nodes[current].value);
+        current = nodes[current].right;
+    }
+    return result;
+}
+
+// Копия уже лежит в прямом порядке
+template <typename T>
+std::vector<T> ConcurrentRedBlackTree<T>::preOrder(const std::vector<SnapshotNode>& nodes)
+{
+    std::vector<T> result;
+    result.reserve(nodes.size());
+    for (const SnapshotNode& node : nodes) {
+        result.push_back(node.value);
+    }
+    return result;
+}
+
+// Порядок «узел, правое, левое», развёрнутый в обратный
+template <typename T>
+std::vector<T> ConcurrentRedBlackTree<T>::postOrder(const std::vector<SnapshotNode>& nodes)
+{
+    std::vector<T> result;
+    result.reserve(nodes.size());
+    std::vector<size_t> stack;
+    if (!nodes.empty()) stack.push_back(0);
+    while (!stack.empty()) {
+        size_t current = stack.back();
+        stack.pop_back();
+        result.push_back(nodes[current].value);
+        if (nodes[current].left != noChild) stack.push_back(nodes[current].left);
+        if (nodes[current].right != noChild) stack.push_back(nodes[current].right);
+    }
+    std::reverse(result.begin(), result.end());
+    return result;
+}
+
+template <typename T>
+std::vector<T> ConcurrentRedBlackTree<T>::breadthFirst(const std::vector<SnapshotNode>& nodes)
+{
+    std::vector<T> result;
+    result.reserve(nodes.size());
+    std::vector<size_t> queue;
+    queue.reserve(nodes.size());
+    if (!nodes.empty()) queue.push_back(0);
+    for (size_t head = 0; head < queue.size(); head++) {
+        const SnapshotNode& node = nodes[queue[head]];
+        result.push_back(node.value);
+        if (node.left != noChild) queue.push_back(node.left);
+        if (node.right != noChild) queue.push_back(node.right);
+    }
+    return result;
+}
+
+template <typename T>
+size_t ConcurrentRedBlackTree<T>::size() const
+{
+    return elements.load(std::memory_order_relaxed);
+}
+
+template <typename T>
+bool ConcurrentRedBlackTree<T>::empty() const
+{
+    return size() == 0;
+}
+
+template <typename T>
+std::vector<T> ConcurrentRedBlackTree<T>::inOrder()
+{
+    Reader reader(*this);
+    return reader.inOrder();
+}
+
+template <typename T>
+std::vector<T> ConcurrentRedBlackTree<T>::preOrder()
+{
+    Reader reader(*this);
+    return reader.preOrder();
+}
+
+template <typename T>
+std::vector<T> ConcurrentRedBlackTree<T>::postOrder()
+{
+    Reader reader(*this);
+    return reader.postOrder();
+}
+
+template <typename T>
+std::vector<T> ConcurrentRedBlackTree<T>::breadthFirstTraversal()
+{
+    Reader reader(*this);
+    return reader.breadthFirstTraversal();
+}
+
+#endif // CONCURRENTREDBLACKTREE_H
@@ -0,0 +1,189 @@
+﻿#ifndef EPOCHALLOCATOR_H
+#define EPOCHALLOCATOR_H
+
+#include "NodeAllocator.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+// Политика выделения узлов с отложенным освобождением по эпохам (epoch-based reclamation).
+// Узлы создаются в пуле, но destroy() не освобождает узел сразу, а откладывает его
+// с номером текущей эпохи. Читатель на время обхода отмечает в своём слоте эпоху,
+// в которой начал читать; узел освобождается, когда все активные читатели начали
+// позже его удаления и уже не могут держать на него указатель.
+// create/destroy/release вызывает только писатель, enter/leave — читатели.
+template <typename Node>
+class EpochAllocator {
+public:
+    // Узлы нельзя освобождать блоками: читатели могут быть ещё внутри дерева
+    static constexpr bool releasesInBulk = false;
+    // Читатели спускаются по дереву одновременно с писателем: ссылки пишутся атомарно
+    static constexpr bool concurrentReaders = true;
+    static const size_t maxReaders = 64;
+    static const size_t noSlot = maxReaders;
+
+    EpochAllocator();
+    ~EpochAllocator();
+
+    EpochAllocator(const EpochAllocator&) = delete;
+    EpochAllocator& operator=(const EpochAllocator&) = delete;
+
+    template <typename... Args>
+    Node* create(Args&&... args);
+    void destroy(Node* node);
+    void release();
+    void swap(EpochAllocator& other) noexcept;
+
+    // Слот читателя или noSlot, если все слоты заняты
+    size_t acquireSlot();
+    void releaseSlot(size_t slot);
+    void enter(size_t slot);
+    void leave(size_t slot);
+
+private:
+    // Каждый слот в своей строке кэша, чтобы читатели не мешали друг другу
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> epoch; // 0 — читатель вне дерева
+        std::atomic<bool> taken;
+    };
+
+    struct Retired {
+        Node* node;
+        uint64_t epoch;
+    };
+
+    static const size_t reclaimThreshold = 1024;
+
+    ReaderSlot slots[maxReaders];
+    std::atomic<uint64_t> globalEpoch;
+    std::vector<Retired> retired;
+    PoolAllocator<Node> pool;
+
+    uint64_t oldestActiveEpoch() const;
+    void reclaim();
+};
+
+template <typename Node>
+EpochAllocator<Node>::EpochAllocator() : globalEpoch(1)
+{
+    for (ReaderSlot& slot : slots) {
+        slot.epoch.store(0, std::memory_order_relaxed);
+        slot.taken.store(false, std::memory_order_relaxed);
+    }
+}
+
+template <typename Node>
+EpochAllocator<Node>::~EpochAllocator()
+{
+    release();
+}
+
+template <typename Node>
+template <typename... Args>
+Node* EpochAllocator<Node>::create(Args&&... args)
+{
+    Node* node = pool.create(std::forward<Args>(args)...);
+    // Поля узла должны стать видны раньше, чем ссылка на него в дереве
+    std::atomic_thread_fence(std::memory_order_release);
+    return node;
+}
+
+template <typename Node>
+void EpochAllocator<Node>::destroy(Node* node)
+{
+    retired.push_back({ node, globalEpoch.load(std::memory_order_relaxed) });
+    if (retired.size() >= reclaimThreshold) {
+        reclaim();
+    }
+}
+
+// Самая ранняя эпоха среди читателей, находящихся в дереве
+template <typename Node>
+uint64_t EpochAllocator<Node>::oldestActiveEpoch() const
+{
+    uint64_t oldest = UINT64_MAX;
+    for (const ReaderSlot& slot : slots) {
+        uint64_t epoch = slot.epoch.load(std::memory_order_acquire);
+        if (epoch != 0 && epoch < oldest) oldest = epoch;
+    }
+    return oldest;
+}
+
+// Новая эпоха отделяет уже удалённые узлы от будущих читателей:
+// освобождаются узлы, удалённые раньше, чем вошёл самый старый активный читатель
+template <typename Node>
+void EpochAllocator<Node>::reclaim()
+{
+    globalEpoch.fetch_add(1, std::memory_order_seq_cst);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    uint64_t oldest = oldestActiveEpoch();
+
+    size_t kept = 0;
+    for (size_t i = 0; i < retired.size(); i++) {
+        if (retired[i].epoch < oldest) {
+            pool.destroy(retired[i].node);
+        }
+        else {
+            retired[kept++] = retired[i];
+        }
+    }
+    retired.resize(kept);
+}
+
+// Всё дерево уже удалено: ждём, пока из него выйдут читатели, вошедшие до этого
+template <typename Node>
+void EpochAllocator<Node>::release()
+{
+    uint64_t barrier = globalEpoch.fetch_add(1, std::memory_order_seq_cst) + 1;
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    while (oldestActiveEpoch() < barrier) {
+        std::this_thread::yield();
+    }
+
+    retired.clear();
+    pool.release();
+}
+
+template <typename Node>
+void EpochAllocator<Node>::swap(EpochAllocator& other) noexcept
+{
+    retired.swap(other.retired);
+    pool.swap(other.pool);
+}
+
+template <typename Node>
+size_t EpochAllocator<Node>::acquireSlot()
+{
+    for (size_t i = 0; i < maxReaders; i++) {
+        bool expected = false;
+        if (!slots[i].taken.load(std::memory_order_relaxed) &&
+            slots[i].taken.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            return i;
+        }
+    }
+    return noSlot;
+}
+
+template <typename Node>
+void EpochAllocator<Node>::releaseSlot(size_t slot)
+{
+    slots[slot].taken.store(false, std::memory_order_release);
+}
+
+template <typename Node>
+void EpochAllocator<Node>::enter(size_t slot)
+{
+    slots[slot].epoch.store(globalEpoch.load(std::memory_order_relaxed), std::memory_order_relaxed);
+    // Эпоха читателя должна стать видна писателю раньше, чем читатель прочтёт дерево
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+template <typename Node>
+void EpochAllocator<Node>::leave(size_t slot)
+{
+    slots[slot].epoch.store(0, std::memory_order_release);
+}
+
+#endif // EPOCHALLOCATOR_H
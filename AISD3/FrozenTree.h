@@ -0,0 +1,448 @@
+﻿#ifndef FROZENTREE_H
+#define FROZENTREE_H
+
+#include "MappedFile.h"
+#include "TreeFormat.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#include <xmmintrin.h>
+#define TREE_PREFETCH(address) _mm_prefetch(reinterpret_cast<const char*>(address), _MM_HINT_T0)
+#else
+#define TREE_PREFETCH(address) __builtin_prefetch(address)
+#endif
+
+// Векторный пакетный поиск. Если компилятор уже собирает под AVX2 (-mavx2, /arch:AVX2),
+// он используется всегда. GCC и Clang на x86 без этого ключа собирают его отдельно
+// с target("avx2") и выбирают при запуске, если процессор умеет AVX2.
+// MSVC без /arch:AVX2 остаётся на скалярном пути
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define FROZEN_TREE_AVX2
+#define FROZEN_TREE_AVX2_TARGET
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FROZEN_TREE_AVX2
+#define FROZEN_TREE_AVX2_TARGET __attribute__((target("avx2")))
+#define FROZEN_TREE_AVX2_DISPATCH
+#endif
+
+// Неизменяемый снимок дерева поиска в раскладке Эйтцингера (BFS-порядок в массиве):
+// корень в ячейке 1, дети ячейки k — в 2k и 2k + 1. Поиск идёт без ветвлений
+// и без указателей, а следующие уровни заранее подгружаются в кэш.
+// Сохранённый снимок можно не копировать: view() и mapFile() ищут прямо
+// по массиву в буфере или в отображённом файле
+template <typename T>
+class FrozenTree {
+public:
+    FrozenTree();
+    explicit FrozenTree(const std::vector<T>& sorted);
+    FrozenTree(const FrozenTree& other);
+    FrozenTree(FrozenTree&& other) noexcept;
+    FrozenTree& operator=(const FrozenTree& other);
+    FrozenTree& operator=(FrozenTree&& other) noexcept;
+
+    size_t size() const;
+    bool empty() const;
+    bool contains(const T& value) const;
+    const T* lowerBound(const T& value) const;
+    void containsBatch(const T* keys, size_t keyCount, bool* found) const;
+
+    FormatError save(std::ostream& out) const;
+    void save(std::vector<char>& buffer) const;
+    FormatError saveFile(const std::string& path) const;
+    // Копируют массив из сохранённого снимка
+    FormatError load(const char* buffer, size_t size);
+    FormatError load(std::istream& input);
+    FormatError loadFile(const std::string& path);
+    // Ищут прямо в буфере, который должен жить дольше снимка, без копирования
+    FormatError view(const char* buffer, size_t size);
+    // Отображает файл в память; отображение живёт, пока жив снимок или его копии
+    FormatError mapFile(const std::string& path);
+
+private:
+    // Сколько элементов помещается в строку кэша: столько уровней вперёд подгружается
+    static constexpr size_t prefetchStride = sizeof(T) < 64 ? 64 / sizeof(T) : 1;
+    // Сколько поисков идут одновременно, перекрывая ожидание памяти
+    static constexpr size_t batchGroup = 16;
+
+    std::vector<T> data; // data[0] не используется; пуст, если снимок смотрит в чужой буфер
+    size_t count;
+    const T* base;       // начало массива: data.data() или место в буфере
+    std::shared_ptr<MappedFile> mapping;
+
+    template <typename Walk>
+    void walkForSave(Walk emit) const;
+    FormatError openView(const char* buffer, size_t size);
+
+    size_t fill(const std::vector<T>& sorted, size_t index, size_t k);
+    size_t lowerBoundIndex(const T& value) const;
+    size_t finishIndex(size_t k) const;
+    void containsGroup(const T* keys, size_t keyCount, bool* found) const;
+#if defined(FROZEN_TREE_AVX2)
+    static bool hasAvx2();
+    FROZEN_TREE_AVX2_TARGET void containsBatchAvx2(const double* keys, size_t keyCount, bool* found) const;
+#endif
+    static int countTrailingOnes(uint64_t x);
+};
+
+template <typename T>
+FrozenTree<T>::FrozenTree() : data(1), count(0), base(data.data()) {}
+
+template <typename T>
+FrozenTree<T>::FrozenTree(const std::vector<T>& sorted) : data(sorted.size() + 1), count(sorted.size()), base(data.data())
+{
+    fill(sorted, 0, 1);
+}
+
+template <typename T>
+FrozenTree<T>::FrozenTree(const FrozenTree& other)
+    : data(other.data), count(other.count), base(data.empty() ? other.base : data.data()), mapping(other.mapping) {}
+
+template <typename T>
+FrozenTree<T>::FrozenTree(FrozenTree&& other) noexcept
+    : data(std::move(other.data)), count(other.count), base(data.empty() ? other.base : data.data()),
+      mapping(std::move(other.mapping))
+{
+    other.data.assign(1, T());
+    other.count = 0;
+    other.base = other.data.data();
+}
+
+template <typename T>
+FrozenTree<T>& FrozenTree<T>::operator=(const FrozenTree& other)
+{
+    if (this != &other) {
+        data = other.data;
+        count = other.count;
+        base = data.empty() ? other.base : data.data();
+        mapping = other.mapping;
+    }
+    return *this;
+}
+
+template <typename T>
+FrozenTree<T>& FrozenTree<T>::operator=(FrozenTree&& other) noexcept
+{
+    if (this != &other) {
+        data = std::move(other.data);
+        count = other.count;
+        base = data.empty() ? other.base : data.data();
+        mapping = std::move(other.mapping);
+        other.data.assign(1, T());
+        other.count = 0;
+        other.base = other.data.data();
+    }
+    return *this;
+}
+
+// Симметричный обход неявного дерева раскладывает отсортированные значения по ячейкам
+template <typename T>
+size_t FrozenTree<T>::fill(const std::vector<T>& sorted, size_t index, size_t k)
+{
+    if (k <= count) {
+        index = fill(sorted, index, 2 * k);
+        data[k] = sorted[index++];
+        index = fill(sorted, index, 2 * k + 1);
+    }
+    return index;
+}
+
+template <typename T>
+size_t FrozenTree<T>::size() const
+{
+    return count;
+}
+
+template <typename T>
+bool FrozenTree<T>::empty() const
+{
+    return count == 0;
+}
+
+template <typename T>
+int FrozenTree<T>::countTrailingOnes(uint64_t x)
+{
+#if defined(_MSC_VER) && defined(_M_X64)
+    unsigned long index;
+    _BitScanForward64(&index, ~x);
+    return static_cast<int>(index);
+#elif defined(_MSC_VER)
+    int ones = 0;
+    for (; x & 1; x >>= 1) ones++;
+    return ones;
+#else
+    return __builtin_ctzll(~x);
+#endif
+}
+
+// Индекс первого элемента, не меньшего value, или 0, если такого нет
+template <typename T>
+size_t FrozenTree<T>::lowerBoundIndex(const T& value) const
+{
+    size_t k = 1;
+
+    while (k <= count) {
+        TREE_PREFETCH(base + k * prefetchStride);
+        k = 2 * k + (base[k] < value);
+    }
+
+    return finishIndex(k);
+}
+
+// Путь после последнего поворота налево заканчивается единицами в младших битах k:
+// их сброс возвращает к узлу, где был этот поворот
+template <typename T>
+size_t FrozenTree<T>::finishIndex(size_t k) const
+{
+    return k >> (countTrailingOnes(k) + 1);
+}
+
+template <typename T>
+const T* FrozenTree<T>::lowerBound(const T& value) const
+{
+    size_t k = lowerBoundIndex(value);
+    return k ? base + k : nullptr;
+}
+
+// Равенство проверяется так же, как в RedBlackTree::search: NaN не равен ничему
+// и не находится, хотя и не меньше ни одного элемента
+template <typename T>
+bool FrozenTree<T>::contains(const T& value) const
+{
+    size_t k = lowerBoundIndex(value);
+    return k && base[k] == value;
+}
+
+// Пакетный поиск: found[i] = contains(keys[i]).
+// Поиски идут группами по batchGroup ключей: все спуски группы делают шаг за шагом
+// одновременно, поэтому промахи кэша разных ключей перекрываются
+template <typename T>
+void FrozenTree<T>::containsBatch(const T* keys, size_t keyCount, bool* found) const
+{
+#if defined(FROZEN_TREE_AVX2)
+    if constexpr (std::is_same<T, double>::value) {
+        if (hasAvx2()) {
+            containsBatchAvx2(reinterpret_cast<const double*>(keys), keyCount, found);
+            return;
+        }
+    }
+#endif
+
+    for (size_t first = 0; first < keyCount; first += batchGroup) {
+        size_t groupSize = keyCount - first < batchGroup ? keyCount - first : batchGroup;
+        containsGroup(keys + first, groupSize, found + first);
+    }
+}
+
+template <typename T>
+void FrozenTree<T>::containsGroup(const T* keys, size_t keyCount, bool* found) const
+{
+    size_t k[batchGroup];
+    for (size_t i = 0; i < keyCount; i++) {
+        k[i] = 1;
+    }
+
+    // Все листья неявного дерева лежат на двух последних уровнях,
+    // поэтому спуски группы заканчиваются почти одновременно
+    bool active = count > 0;
+    while (active) {
+        active = false;
+        for (size_t i = 0; i < keyCount; i++) {
+            if (k[i] <= count) {
+                k[i] = 2 * k[i] + (base[k[i]] < keys[i]);
+                TREE_PREFETCH(base + k[i] * prefetchStride);
+                active = true;
+            }
+        }
+    }
+
+    for (size_t i = 0; i < keyCount; i++) {
+        size_t index = finishIndex(k[i]);
+        found[i] = index && base[index] == keys[i];
+    }
+}
+
+#if defined(FROZEN_TREE_AVX2)
+// Процессор проверяется один раз на всю программу
+template <typename T>
+bool FrozenTree<T>::hasAvx2()
+{
+#if defined(FROZEN_TREE_AVX2_DISPATCH)
+    static const bool supported = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return supported;
+#else
+    return true;
+#endif
+}
+
+// Четыре ключа double за инструкцию: индексы лежат в 64-битных дорожках,
+// значения узлов собираются gather-загрузкой, сравнение даёт шаг вправо.
+// Одновременно идут batchGroup / 4 векторов, чтобы промахи кэша перекрывались
+template <typename T>
+FROZEN_TREE_AVX2_TARGET void FrozenTree<T>::containsBatchAvx2(const double* keys, size_t keyCount, bool* found) const
+{
+    static constexpr size_t vectors = batchGroup / 4;
+    const double* values = reinterpret_cast<const double*>(base);
+    const __m256i one = _mm256_set1_epi64x(1);
+    const __m256i limit = _mm256_set1_epi64x(static_cast<long long>(count) + 1);
+
+    size_t first = 0;
+    for (; first + batchGroup <= keyCount; first += batchGroup) {
+        __m256d key[vectors];
+        __m256i k[vectors];
+        for (size_t v = 0; v < vectors; v++) {
+            key[v] = _mm256_loadu_pd(keys + first + 4 * v);
+            k[v] = one;
+        }
+
+        bool active = count > 0;
+        while (active) {
+            active = false;
+            for (size_t v = 0; v < vectors; v++) {
+                __m256i running = _mm256_cmpgt_epi64(limit, k[v]);
+                if (_mm256_testz_si256(running, running)) continue;
+                active = true;
+
+                // Закончившие спуск дорожки читают data[0], их индекс не меняется
+                __m256i index = _mm256_and_si256(k[v], running);
+                __m256d value = _mm256_i64gather_pd(values, index, 8);
+                __m256i goRight = _mm256_castpd_si256(_mm256_cmp_pd(value, key[v], _CMP_LT_OQ));
+                __m256i next = _mm256_sub_epi64(_mm256_add_epi64(k[v], k[v]), goRight);
+                k[v] = _mm256_blendv_epi8(k[v], next, running);
+
+                alignas(32) long long lanes[4];
+                _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), k[v]);
+                for (size_t lane = 0; lane < 4; lane++) {
+                    TREE_PREFETCH(values + static_cast<size_t>(lanes[lane]) * prefetchStride);
+                }
+            }
+        }
+
+        for (size_t v = 0; v < vectors; v++) {
+            alignas(32) long long lanes[4];
+            _mm256_store_si256(reinterpret_cast<__m256i*>(lanes), k[v]);
+            for (size_t lane = 0; lane < 4; lane++) {
+                size_t i = first + 4 * v + lane;
+                size_t index = finishIndex(static_cast<size_t>(lanes[lane]));
+                found[i] = index && values[index] == keys[i];
+            }
+        }
+    }
+
+    if (first < keyCount) {
+        containsGroup(reinterpret_cast<const T*>(keys + first), keyCount - first, found + first);
+    }
+}
+#endif
+
+template <typename T>
+template <typename Walk>
+void FrozenTree<T>::walkForSave(Walk emit) const
+{
+    for (size_t k = 0; k <= count; k++) {
+        emit(false, false, false, base[k]);
+    }
+}
+
+template <typename T>
+FormatError FrozenTree<T>::save(std::ostream& out) const
+{
+    return TreeFormat<T>::save(out, TreeKind::Frozen, count, [this](auto emit) { walkForSave(emit); });
+}
+
+template <typename T>
+void FrozenTree<T>::save(std::vector<char>& buffer) const
+{
+    TreeFormat<T>::save(buffer, TreeKind::Frozen, count, [this](auto emit) { walkForSave(emit); });
+}
+
+template <typename T>
+FormatError FrozenTree<T>::saveFile(const std::string& path) const
+{
+    return TreeFormat<T>::saveFile(path, TreeKind::Frozen, count, [this](auto emit) { walkForSave(emit); });
+}
+
+template <typename T>
+FormatError FrozenTree<T>::load(const char* buffer, size_t size)
+{
+    typename TreeFormat<T>::Layout layout;
+    FormatError error = TreeFormat<T>::open(buffer, size, TreeKind::Frozen, layout);
+    if (error != FormatError::None) return error;
+
+    data.resize(static_cast<size_t>(layout.count) + 1);
+    std::memcpy(data.data(), buffer + layout.values, data.size() * sizeof(T));
+    count = static_cast<size_t>(layout.count);
+    base = data.data();
+    mapping.reset();
+    return FormatError::None;
+}
+
+template <typename T>
+FormatError FrozenTree<T>::load(std::istream& input)
+{
+    std::vector<char> buffer;
+    FormatError error = TreeFormat<T>::readAll(input, buffer);
+    if (error != FormatError::None) return error;
+    return load(buffer.data(), buffer.size());
+}
+
+template <typename T>
+FormatError FrozenTree<T>::loadFile(const std::string& path)
+{
+    return TreeFormat<T>::loadFile(path, [this](const char* buffer, size_t size) {
+        return load(buffer, size);
+    });
+}
+
+// Порядок значений не проверяется: проверка прочла бы весь файл,
+// а снимок из отображённого файла готов к поиску без чтения массива
+template <typename T>
+FormatError FrozenTree<T>::openView(const char* buffer, size_t size)
+{
+    typename TreeFormat<T>::Layout layout;
+    FormatError error = TreeFormat<T>::open(buffer, size, TreeKind::Frozen, layout);
+    if (error != FormatError::None) return error;
+
+    const char* values = buffer + layout.values;
+    if (reinterpret_cast<std::uintptr_t>(values) % alignof(T) != 0) return FormatError::Misaligned;
+
+    data.clear();
+    data.shrink_to_fit();
+    count = static_cast<size_t>(layout.count);
+    base = reinterpret_cast<const T*>(values);
+    return FormatError::None;
+}
+
+template <typename T>
+FormatError FrozenTree<T>::view(const char* buffer, size_t size)
+{
+    FormatError error = openView(buffer, size);
+    if (error == FormatError::None) mapping.reset();
+    return error;
+}
+
+template <typename T>
+FormatError FrozenTree<T>::mapFile(const std::string& path)
+{
+    std::shared_ptr<MappedFile> file = std::make_shared<MappedFile>(path);
+    if (!file->isOpen()) return FormatError::ReadFailure;
+
+    FormatError error = openView(file->data(), file->size());
+    if (error == FormatError::None) mapping = file;
+    return error;
+}
+
+#endif // FROZENTREE_H
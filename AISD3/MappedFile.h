@@ -0,0 +1,157 @@
+﻿#ifndef MAPPEDFILE_H
+#define MAPPEDFILE_H
+
+#include <cstddef>
+#include <string>
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Файл, отображённый в память только для чтения: разбор идёт прямо по страницам
+// кэша ОС, без копирования в std::string. Отображаются только обычные файлы;
+// для каналов, устройств и ошибок открытия isOpen() возвращает false,
+// и вызывающий читает файл потоком
+class MappedFile {
+public:
+    MappedFile();
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const;
+    const char* data() const;
+    size_t size() const;
+
+private:
+    const char* view;
+    size_t length;
+    bool opened;
+};
+
+inline MappedFile::MappedFile() : view(nullptr), length(0), opened(false) {}
+
+inline MappedFile::MappedFile(const std::string& path) : view(nullptr), length(0), opened(false)
+{
+    open(path);
+}
+
+inline MappedFile::~MappedFile()
+{
+    close();
+}
+
+#if defined(_WIN32)
+inline bool MappedFile::open(const std::string& path)
+{
+    close();
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return false;
+
+    LARGE_INTEGER fileSize;
+    if (GetFileType(file) != FILE_TYPE_DISK || !GetFileSizeEx(file, &fileSize)) {
+        CloseHandle(file);
+        return false;
+    }
+
+    // Пустой файл отобразить нельзя, но прочитан он успешно
+    if (fileSize.QuadPart == 0) {
+        CloseHandle(file);
+        opened = true;
+        return true;
+    }
+
+    HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) return false;
+
+    // Отображение держит файл открытым само
+    view = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    CloseHandle(mapping);
+    if (!view) return false;
+
+    length = static_cast<size_t>(fileSize.QuadPart);
+    opened = true;
+    return true;
+}
+
+inline void MappedFile::close()
+{
+    if (view) UnmapViewOfFile(view);
+    view = nullptr;
+    length = 0;
+    opened = false;
+}
+#else
+inline bool MappedFile::open(const std::string& path)
+{
+    close();
+
+    int descriptor = ::open(path.c_str(), O_RDONLY);
+    if (descriptor < 0) return false;
+
+    struct stat status;
+    if (fstat(descriptor, &status) != 0 || !S_ISREG(status.st_mode)) {
+        ::close(descriptor);
+        return false;
+    }
+
+    if (status.st_size == 0) {
+        ::close(descriptor);
+        opened = true;
+        return true;
+    }
+
+    void* mapped = mmap(nullptr, static_cast<size_t>(status.st_size), PROT_READ, MAP_PRIVATE, descriptor, 0);
+    // Отображение держит файл открытым само
+    ::close(descriptor);
+    if (mapped == MAP_FAILED) return false;
+
+    // Разбор идёт строго вперёд: ядро читает страницы заранее и быстрее отпускает прочитанные
+    madvise(mapped, static_cast<size_t>(status.st_size), MADV_SEQUENTIAL);
+
+    view = static_cast<const char*>(mapped);
+    length = static_cast<size_t>(status.st_size);
+    opened = true;
+    return true;
+}
+
+inline void MappedFile::close()
+{
+    if (view) munmap(const_cast<char*>(view), length);
+    view = nullptr;
+    length = 0;
+    opened = false;
+}
+#endif
+
+inline bool MappedFile::isOpen() const
+{
+    return opened;
+}
+
+inline const char* MappedFile::data() const
+{
+    return view;
+}
+
+inline size_t MappedFile::size() const
+{
+    return length;
+}
+
+#endif // MAPPEDFILE_H
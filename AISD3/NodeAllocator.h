@@ -0,0 +1,188 @@
+﻿#ifndef NODEALLOCATOR_H
+#define NODEALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Политики выделения памяти под узлы деревьев.
+// Дерево создаёт узлы через create(...), возвращает через destroy(node),
+// а release() освобождает сразу всю память аллокатора.
+// splice(other) забирает себе узлы другого аллокатора того же типа:
+// так соединяются поддеревья, построенные в разных потоках.
+
+// Пул (slab/arena): узлы нарезаются подряд из крупных блоков,
+// освобождённые узлы попадают в список свободных и переиспользуются.
+template <typename Node>
+class PoolAllocator {
+public:
+    // Дерево целиком можно освободить через release(), не обходя узлы
+    static constexpr bool releasesInBulk = true;
+    // Дерево с этим аллокатором не читают без блокировок, ссылки пишутся обычным присваиванием
+    static constexpr bool concurrentReaders = false;
+
+    PoolAllocator();
+    ~PoolAllocator();
+
+    PoolAllocator(const PoolAllocator&) = delete;
+    PoolAllocator& operator=(const PoolAllocator&) = delete;
+
+    template <typename... Args>
+    Node* create(Args&&... args);
+    void destroy(Node* node);
+    void release();
+    void swap(PoolAllocator& other) noexcept;
+    void splice(PoolAllocator& other);
+
+private:
+    union Slot {
+        Slot* next;
+        alignas(Node) unsigned char storage[sizeof(Node)];
+    };
+
+    static const size_t firstBlockSize = 64;
+    static const size_t maxBlockSize = 65536;
+
+    std::vector<Slot*> blocks;
+    Slot* freeList;
+    Slot* cursor;
+    Slot* blockEnd;
+    size_t nextBlockSize;
+
+    void allocateBlock();
+};
+
+// Обычные new/delete на каждый узел
+template <typename Node>
+class NewDeleteAllocator {
+public:
+    static constexpr bool releasesInBulk = false;
+    static constexpr bool concurrentReaders = false;
+
+    template <typename... Args>
+    Node* create(Args&&... args);
+    void destroy(Node* node);
+    void release();
+    void swap(NewDeleteAllocator& other) noexcept;
+    void splice(NewDeleteAllocator& other);
+};
+
+template <typename Node>
+PoolAllocator<Node>::PoolAllocator()
+    : freeList(nullptr), cursor(nullptr), blockEnd(nullptr), nextBlockSize(firstBlockSize) {}
+
+template <typename Node>
+PoolAllocator<Node>::~PoolAllocator()
+{
+    release();
+}
+
+template <typename Node>
+void PoolAllocator<Node>::allocateBlock()
+{
+    Slot* block = static_cast<Slot*>(::operator new(nextBlockSize * sizeof(Slot)));
+    blocks.push_back(block);
+    cursor = block;
+    blockEnd = block + nextBlockSize;
+
+    if (nextBlockSize < maxBlockSize) {
+        nextBlockSize *= 2;
+    }
+}
+
+template <typename Node>
+template <typename... Args>
+Node* PoolAllocator<Node>::create(Args&&... args)
+{
+    Slot* slot;
+    if (freeList) {
+        slot = freeList;
+        freeList = freeList->next;
+    }
+    else {
+        if (cursor == blockEnd) {
+            allocateBlock();
+        }
+        slot = cursor++;
+    }
+
+    return new (slot->storage) Node(std::forward<Args>(args)...);
+}
+
+template <typename Node>
+void PoolAllocator<Node>::destroy(Node* node)
+{
+    node->~Node();
+    Slot* slot = reinterpret_cast<Slot*>(node);
+    slot->next = freeList;
+    freeList = slot;
+}
+
+template <typename Node>
+void PoolAllocator<Node>::release()
+{
+    for (Slot* block : blocks) {
+        ::operator delete(block);
+    }
+    blocks.clear();
+    freeList = nullptr;
+    cursor = nullptr;
+    blockEnd = nullptr;
+    nextBlockSize = firstBlockSize;
+}
+
+template <typename Node>
+void PoolAllocator<Node>::swap(PoolAllocator& other) noexcept
+{
+    blocks.swap(other.blocks);
+    std::swap(freeList, other.freeList);
+    std::swap(cursor, other.cursor);
+    std::swap(blockEnd, other.blockEnd);
+    std::swap(nextBlockSize, other.nextBlockSize);
+}
+
+// Блоки other переходят к этому пулу вместе с живыми в них узлами.
+// Незанятый хвост текущего блока other не переиспользуется до release()
+template <typename Node>
+void PoolAllocator<Node>::splice(PoolAllocator& other)
+{
+    blocks.insert(blocks.end(), other.blocks.begin(), other.blocks.end());
+
+    if (other.freeList) {
+        Slot* last = other.freeList;
+        while (last->next) last = last->next;
+        last->next = freeList;
+        freeList = other.freeList;
+    }
+
+    other.blocks.clear();
+    other.freeList = nullptr;
+    other.cursor = nullptr;
+    other.blockEnd = nullptr;
+    other.nextBlockSize = firstBlockSize;
+}
+
+template <typename Node>
+template <typename... Args>
+Node* NewDeleteAllocator<Node>::create(Args&&... args)
+{
+    return new Node(std::forward<Args>(args)...);
+}
+
+template <typename Node>
+void NewDeleteAllocator<Node>::destroy(Node* node)
+{
+    delete node;
+}
+
+template <typename Node>
+void NewDeleteAllocator<Node>::release() {}
+
+template <typename Node>
+void NewDeleteAllocator<Node>::swap(NewDeleteAllocator&) noexcept {}
+
+template <typename Node>
+void NewDeleteAllocator<Node>::splice(NewDeleteAllocator&) {}
+
+#endif // NODEALLOCATOR_H
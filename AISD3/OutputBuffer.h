@@ -0,0 +1,243 @@
+﻿#ifndef OUTPUTBUFFER_H
+#define OUTPUTBUFFER_H
+
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+enum class OutputFormat {
+    Text,  // кратчайшая запись, из которой значение читается обратно без потерь, через пробел
+    Binary // побайтовые копии значений подряд, без разделителей
+};
+
+// Вывод обходов без iostream: значения форматируются std::to_chars прямо в большой
+// буфер, который уходит в дескриптор системным вызовом write, когда заполнится.
+// Перед выводом в stdout тот же поток, что пишет std::cout, нужно сбросить
+class OutputBuffer {
+public:
+    static const size_t defaultCapacity = 1 << 20;
+
+    explicit OutputBuffer(int descriptor = 1, OutputFormat format = OutputFormat::Text, size_t capacity = defaultCapacity);
+    // Вывод дописывается в строку target при каждом сбросе буфера
+    explicit OutputBuffer(std::string& target, OutputFormat format = OutputFormat::Text, size_t capacity = defaultCapacity);
+    ~OutputBuffer();
+
+    OutputBuffer(const OutputBuffer&) = delete;
+    OutputBuffer& operator=(const OutputBuffer&) = delete;
+
+    // Пишет в файл вместо дескриптора из конструктора; файл усекается
+    bool open(const std::string& path);
+    void close();
+    bool isOpen() const;
+    OutputFormat format() const;
+    void setFormat(OutputFormat format);
+    // false, если какая-то запись не удалась
+    bool good() const;
+
+    // Элемент обхода: в тексте отделяется пробелом от предыдущего
+    template <typename T>
+    void value(const T& value);
+    // Число всегда текстом, без разделителя
+    template <typename T>
+    void number(T value);
+    void text(const char* text, size_t length);
+    void text(const std::string& text);
+    // Конец строки обхода; в двоичном формате ничего не пишет
+    void endLine();
+    bool flush();
+
+private:
+    // Длиннее не бывает ни одно число из to_chars (double — до 24 символов)
+    static const size_t maxNumberLength = 64;
+
+    int descriptor;
+    std::string* target;
+    bool owned;
+    OutputFormat mode;
+    std::vector<char> buffer;
+    size_t used;
+    bool separate;
+    bool failed;
+
+    void writeAll(const char* data, size_t length);
+    char* reserve(size_t length);
+};
+
+inline OutputBuffer::OutputBuffer(int descriptor, OutputFormat format, size_t capacity)
+    : descriptor(descriptor), target(nullptr), owned(false), mode(OutputFormat::Text),
+      buffer(capacity < maxNumberLength ? maxNumberLength : capacity), used(0), separate(false), failed(false)
+{
+    setFormat(format);
+}
+
+inline OutputBuffer::OutputBuffer(std::string& target, OutputFormat format, size_t capacity)
+    : descriptor(-1), target(&target), owned(false), mode(format),
+      buffer(capacity < maxNumberLength ? maxNumberLength : capacity), used(0), separate(false), failed(false) {}
+
+inline OutputBuffer::~OutputBuffer()
+{
+    close();
+}
+
+inline bool OutputBuffer::open(const std::string& path)
+{
+    close();
+#if defined(_WIN32)
+    descriptor = _open(path.c_str(), _O_WRONLY | _O_CREAT | _O_TRUNC | _O_BINARY, _S_IREAD | _S_IWRITE);
+#else
+    descriptor = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+#endif
+    target = nullptr;
+    owned = descriptor >= 0;
+    failed = !owned;
+    separate = false;
+    return owned;
+}
+
+inline void OutputBuffer::close()
+{
+    flush();
+    if (owned) {
+#if defined(_WIN32)
+        _close(descriptor);
+#else
+        ::close(descriptor);
+#endif
+    }
+    owned = false;
+    descriptor = -1;
+    target = nullptr;
+}
+
+inline bool OutputBuffer::isOpen() const
+{
+    return descriptor >= 0 || target;
+}
+
+inline OutputFormat OutputBuffer::format() const
+{
+    return mode;
+}
+
+inline void OutputBuffer::setFormat(OutputFormat format)
+{
+    mode = format;
+#if defined(_WIN32)
+    // Иначе CRT в текстовом режиме заменит каждый байт 0x0A на пару 0x0D 0x0A
+    if (mode == OutputFormat::Binary && descriptor >= 0) {
+        flush();
+        _setmode(descriptor, _O_BINARY);
+    }
+#endif
+}
+
+inline bool OutputBuffer::good() const
+{
+    return !failed;
+}
+
+inline void OutputBuffer::writeAll(const char* data, size_t length)
+{
+    if (target) {
+        target->append(data, length);
+        return;
+    }
+    if (descriptor < 0) return;
+
+    while (length && !failed) {
+#if defined(_WIN32)
+        int written = _write(descriptor, data, static_cast<unsigned int>(length));
+#else
+        ssize_t written = ::write(descriptor, data, length);
+#endif
+        if (written <= 0) {
+            failed = true;
+            break;
+        }
+        data += written;
+        length -= static_cast<size_t>(written);
+    }
+}
+
+inline bool OutputBuffer::flush()
+{
+    if (used) {
+        writeAll(buffer.data(), used);
+    }
+    used = 0;
+    return !failed;
+}
+
+inline char* OutputBuffer::reserve(size_t length)
+{
+    if (used + length > buffer.size()) {
+        flush();
+    }
+    return buffer.data() + used;
+}
+
+template <typename T>
+void OutputBuffer::value(const T& value)
+{
+    static_assert(std::is_arithmetic<T>::value, "OutputBuffer writes numbers only");
+
+    if (mode == OutputFormat::Binary) {
+        std::memcpy(reserve(sizeof(T)), &value, sizeof(T));
+        used += sizeof(T);
+        return;
+    }
+
+    if (separate) {
+        *reserve(1) = ' ';
+        used++;
+    }
+    number(value);
+    separate = true;
+}
+
+template <typename T>
+void OutputBuffer::number(T value)
+{
+    char* first = reserve(maxNumberLength);
+    std::to_chars_result result = std::to_chars(first, first + maxNumberLength, value);
+    used += static_cast<size_t>(result.ptr - first);
+}
+
+inline void OutputBuffer::text(const char* text, size_t length)
+{
+    if (length > buffer.size()) {
+        flush();
+        writeAll(text, length);
+        return;
+    }
+    std::memcpy(reserve(length), text, length);
+    used += length;
+}
+
+inline void OutputBuffer::text(const std::string& text)
+{
+    this->text(text.data(), text.size());
+}
+
+inline void OutputBuffer::endLine()
+{
+    separate = false;
+    if (mode == OutputFormat::Text) {
+        *reserve(1) = '\n';
+        used++;
+    }
+}
+
+#endif // OUTPUTBUFFER_H
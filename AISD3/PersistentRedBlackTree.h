@@ -0,0 +1,370 @@
+﻿#ifndef PERSISTENTREDBLACKTREE_H
+#define PERSISTENTREDBLACKTREE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <vector>
+
+// Персистентное (функциональное) красно-чёрное дерево.
+// Узлы неизменяемы и разделяются между версиями через std::shared_ptr:
+// insert и deleteNode копируют только путь от корня до места изменения
+// (O(log n) новых узлов) и возвращают новую версию, старая остаётся целой.
+// Снимок — копия объекта за O(1), ненужные версии освобождаются подсчётом ссылок.
+// Вставка по Окасаки, удаление по Карсу (S. Kahrs, "Red-black trees with types").
+template <typename T>
+class PersistentRedBlackTree {
+private:
+    enum Color { RED, BLACK };
+
+    struct TreeNode;
+    typedef std::shared_ptr<const TreeNode> NodePtr;
+
+    struct TreeNode {
+        T value;
+        Color color;
+        NodePtr left;
+        NodePtr right;
+
+        TreeNode(Color color, const NodePtr& left, const T& value, const NodePtr& right);
+    };
+
+    NodePtr root;
+    size_t nodeCount;
+
+    PersistentRedBlackTree(const NodePtr& root, size_t nodeCount);
+
+    static NodePtr makeNode(Color color, const NodePtr& left, const T& value, const NodePtr& right);
+    static bool isRed(const NodePtr& node);
+    static bool isBlack(const NodePtr& node);
+    static NodePtr balance(const NodePtr& left, const T& value, const NodePtr& right);
+    static NodePtr insertInto(const NodePtr& node, const T& value);
+    static NodePtr deleteFrom(const NodePtr& node, const T& value);
+    static NodePtr balanceLeft(const NodePtr& left, const T& value, const NodePtr& right);
+    static NodePtr balanceRight(const NodePtr& left, const T& value, const NodePtr& right);
+    static NodePtr append(const NodePtr& left, const NodePtr& right);
+    static NodePtr redden(const NodePtr& node);
+    static NodePtr buildBalanced(const T* values, size_t count, int depth, int redDepth);
+
+public:
+    PersistentRedBlackTree();
+    explicit PersistentRedBlackTree(const std::vector<T>& data);
+
+    PersistentRedBlackTree snapshot() const;
+    PersistentRedBlackTree insert(const T& value) const;
+    PersistentRedBlackTree deleteNode(const T& value) const;
+
+    bool empty() const;
+    size_t size() const;
+    const T* search(const T& value) const;
+    bool contains(const T& value) const;
+    template <typename Visit>
+    void visitInOrder(Visit visit) const;
+    std::vector<T> inOrder() const;
+    int getHeight() const;
+};
+
+template <typename T>
+PersistentRedBlackTree<T>::TreeNode::TreeNode(Color color, const NodePtr& left, const T& value, const NodePtr& right)
+    : value(value), color(color), left(left), right(right) {}
+
+template <typename T>
+PersistentRedBlackTree<T>::PersistentRedBlackTree() : nodeCount(0) {}
+
+template <typename T>
+PersistentRedBlackTree<T>::PersistentRedBlackTree(const NodePtr& root, size_t nodeCount) : root(root), nodeCount(nodeCount) {}
+
+// Сбалансированная версия из произвольных данных, как RedBlackTree::bulkLoad
+template <typename T>
+PersistentRedBlackTree<T>::PersistentRedBlackTree(const std::vector<T>& data) : nodeCount(data.size())
+{
+    std::vector<T> sorted(data);
+    std::sort(sorted.begin(), sorted.end());
+
+    int height = 0;
+    while ((size_t(1) << height) - 1 < sorted.size()) {
+        height++;
+    }
+
+    int redDepth = ((size_t(1) << height) - 1 == sorted.size()) ? -1 : height - 1;
+    root = buildBalanced(sorted.data(), sorted.size(), 0, redDepth);
+}
+
+template <typename T>
+typename PersistentRedBlackTree<T>::NodePtr PersistentRedBlackTree<T>::buildBalanced(const T* values, size_t count, int depth, int redDepth)
+{
+    if (count == 0) return NodePtr();
+
+    size_t middle = count / 2;
+    NodePtr left = buildBalanced(values, middle, depth + 1, redDepth);
+    NodePtr right = buildBalanced(values + middle + 1, count - middle - 1, depth + 1, redDepth);
+    return makeNode(depth == redDepth ? RED : BLACK, left, values[middle], right);
+}
+
+template <typename T>
+typename PersistentRedBlackTree<T>::NodePtr PersistentRedBlackTree<T>::makeNode(Color color, const NodePtr& left, const T& value, const NodePtr& right)
+{
+    return std::make_shared<const TreeNode>(color, left, value, right);
+}
+
+template <typename T>
+bool PersistentRedBlackTree<T>::isRed(const NodePtr& node)
+{
+    return node && node->color == RED;
+}
+
+template <typename T>
+bool PersistentRedBlackTree<T>::isBlack(const NodePtr& node)
+{
+    return node && node->color == BLACK;
+}
+
+// Узел (left, value, right) с устранением двух красных подряд под ним.
+// Все четыре случая «красный ребёнок с красным внуком» сводятся к одной форме:
+// красный корень с двумя чёрными детьми
+template <typename T>
+typename PersistentRedBlackTree<T>::NodePtr PersistentRedBlackTree<T>::balance(const NodePtr& left, const T& value, const NodePtr& right)
+{
+    if (isRed(left) && isRed(right)) {
+        return makeNode(RED, makeNode(BLACK, left->left, left->value, left->right), value,
+                        makeNode(BLACK, right->left, right->value, right->right));
+    }
+    if (isRed(left) && isRed(left->left)) {
+        const NodePtr& grandchild = left->left;
+        return makeNode(RED, makeNode(BLACK, grandchild->left, grandchild->value, grandchild->right), left->value,
+                        makeNode(BLACK, left->right, value, right));
+    }
+    if (isRed(left) && isRed(left->right)) {
+        const NodePtr& grandchild = left->right;
+        return makeNode(RED, makeNode(BLACK, left->left, left->value, grandchild->left), grandchild->value,
+                        makeNode(BLACK, grandchild->right, value, right));
+    }
+    if (isRed(right) && isRed(right->right)) {
+        const NodePtr& grandchild = right->right;
+        return makeNode(RED, makeNode(BLACK, left, value, right->left), right->value,
+                        makeNode(BLACK, grandchild->left, grandchild->value, grandchild->right));
+    }
+    if (isRed(right) && isRed(right->left)) {
+        const NodePtr& grandchild = right->left;
+        return makeNode(RED, makeNode(BLACK, left, value, grandchild->left), grandchild->value,
+                        makeNode(BLACK, grandchild->right, right->value, right->right));
+    }
+    return makeNode(BLACK, left, value, right);
+}
+
+// Равные значения, как и в RedBlackTree, уходят вправо
+template <typename T>
+typename PersistentRedBlackTree<T>::NodePtr PersistentRedBlackTree<T>::insertInto(const NodePtr& node, const T& value)
+{
+    if (!node) return makeNode(RED, NodePtr(), value, NodePtr());
+
+    if (node->color == BLACK) {
+        if (value < node->value) return balance(insertInto(node->left, value), node->value, node->right);
+        return balance(node->left, node->value, insertInto(node->right, value));
+    }
+
+    if (value < node->value) return makeNode(RED, insertInto(node->left, value), node->value, node->right);
+    return makeNode(RED, node->left, node->value, insertInto(node->right, value));
+}
+
+// Чёрный узел становится красным: чёрная высота поддерева уменьшается на 1
+template <typename T>
+typename PersistentRedBlackTree<T>::NodePtr PersistentRedBlackTree<T>::redden(const NodePtr& node)
+{
+    return makeNode(RED, node->left, node->value, node->right);
+}
+
+// Левое поддерево после удаления стало на один чёрный уровень ниже правого
+template <typename T>
+typename PersistentRedBlackTree<T>::NodePtr PersistentRedBlackTree<T>::balanceLeft(const NodePtr& left, const T& value, const NodePtr& right)
+{
+    if (isRed(left)) {
+        return makeNode(RED, makeNode(BLACK, left->left, left->value, left->right), value, right);
+    }
+    if (isBlack(right)) {
+        return balance(left, value, redden(right));
+    }
+    // right красный, его левый ребёнок чёрный
+    const NodePtr& inner = right->left;
+    return makeNode(RED, makeNode(BLACK, left, value, inner->left), inner->value,
+                    balance(inner->right, right->value, redden(right->right)));
+}
+
+// Правое поддерево после удаления стало на один чёрный уровень ниже левого
+template <typename T>
+typename PersistentRedBlackTree<T>::NodePtr PersistentRedBlackTree<T>::balanceRight(const NodePtr& left, const T& value, const NodePtr& right)
+{
+    if (isRed(right)) {
+        return makeNode(RED, left, value, makeNode(BLACK, right->left, right->value, right->right));
+    }
+    if (isBlack(left)) {
+        return balance(redden(left), value, right);
+    }
+    // left красный, его правый ребёнок чёрный
+    const NodePtr& inner = left->right;
+    return makeNode(RED, balance(redden(left->left), left->value, inner->left), inner->value,
+                    makeNode(BLACK, inner->right, value, right));
+}
+
+// Сцепление двух поддеревьев одной чёрной высоты на месте удалённого узла
+template <typename T>
+typename PersistentRedBlackTree<T>::NodePtr PersistentRedBlackTree<T>::append(const NodePtr& left, const NodePtr& right)
+{
+    if (!left) return right;
+    if (!right) return left;
+
+    if (isRed(left) && isRed(right)) {
+        NodePtr middle = append(left->right, right->left);
+        if (isRed(middle)) {
+            return makeNode(RED, makeNode(RED, left->left, left->value, middle->left), middle->value,
+                            makeNode(RED, middle->right, right->value, right->right));
+        }
+        return makeNode(RED, left->left, left->value, makeNode(RED, middle, right->value, right->right));
+    }
+    if (isBlack(left) && isBlack(right)) {
+        NodePtr middle = append(left->right, right->left);
+        if (isRed(middle)) {
+            return makeNode(RED, makeNode(BLACK, left->left, left->value, middle->left), middle->value,
+                            makeNode(BLACK, middle->right, right->value, right->right));
+        }
+        return balanceLeft(left->left, left->value, makeNode(BLACK, middle, right->value, right->right));
+    }
+    if (isRed(right)) {
+        return makeNode(RED, append(left, right->left), right->value, right->right);
+    }
+    return makeNode(RED, left->left, left->value, append(left->right, right));
+}
+
+// Удаление одного вхождения value; вызывается, только если value есть в дереве
+template <typename T>
+typename PersistentRedBlackTree<T>::NodePtr PersistentRedBlackTree<T>::deleteFrom(const NodePtr& node, const T& value)
+{
+    if (!node) return node;
+
+    if (value < node->value) {
+        NodePtr left = deleteFrom(node->left, value);
+        if (isBlack(node->left)) return balanceLeft(left, node->value, node->right);
+        return makeNode(RED, left, node->value, node->right);
+    }
+    if (node->value < value) {
+        NodePtr right = deleteFrom(node->right, value);
+        if (isBlack(node->right)) return balanceRight(node->left, node->value, right);
+        return makeNode(RED, node->left, node->value, right);
+    }
+    return append(node->left, node->right);
+}
+
+template <typename T>
+PersistentRedBlackTree<T> PersistentRedBlackTree<T>::snapshot() const
+{
+    return *this;
+}
+
+template <typename T>
+PersistentRedBlackTree<T> PersistentRedBlackTree<T>::insert(const T& value) const
+{
+    NodePtr inserted = insertInto(root, value);
+    if (inserted->color == RED) {
+        inserted = makeNode(BLACK, inserted->left, inserted->value, inserted->right);
+    }
+    return PersistentRedBlackTree(inserted, nodeCount + 1);
+}
+
+// Если value в дереве нет, возвращается та же версия
+template <typename T>
+PersistentRedBlackTree<T> PersistentRedBlackTree<T>::deleteNode(const T& value) const
+{
+    if (!search(value)) return *this;
+
+    NodePtr remaining = deleteFrom(root, value);
+    if (isRed(remaining)) {
+        remaining = makeNode(BLACK, remaining->left, remaining->value, remaining->right);
+    }
+    return PersistentRedBlackTree(remaining, nodeCount - 1);
+}
+
+template <typename T>
+bool PersistentRedBlackTree<T>::empty() const
+{
+    return !root;
+}
+
+template <typename T>
+size_t PersistentRedBlackTree<T>::size() const
+{
+    return nodeCount;
+}
+
+template <typename T>
+const T* PersistentRedBlackTree<T>::search(const T& value) const
+{
+    const TreeNode* node = root.get();
+    while (node) {
+        if (value < node->value) {
+            node = node->left.get();
+        }
+        else if (node->value < value) {
+            node = node->right.get();
+        }
+        else {
+            return &node->value;
+        }
+    }
+    return nullptr;
+}
+
+template <typename T>
+bool PersistentRedBlackTree<T>::contains(const T& value) const
+{
+    return search(value) != nullptr;
+}
+
+// Родительских указателей нет: путь к текущему узлу хранится в стеке глубины O(log n)
+template <typename T>
+template <typename Visit>
+void PersistentRedBlackTree<T>::visitInOrder(Visit visit) const
+{
+    std::vector<const TreeNode*> path;
+    const TreeNode* current = root.get();
+
+    while (current || !path.empty()) {
+        while (current) {
+            path.push_back(current);
+            current = current->left.get();
+        }
+
+        current = path.back();
+        path.pop_back();
+        visit(current->value);
+        current = current->right.get();
+    }
+}
+
+template <typename T>
+std::vector<T> PersistentRedBlackTree<T>::inOrder() const
+{
+    std::vector<T> res;
+    res.reserve(nodeCount);
+    visitInOrder([&res](const T& value) { res.push_back(value); });
+    return res;
+}
+
+template <typename T>
+int PersistentRedBlackTree<T>::getHeight() const
+{
+    int height = 0;
+    std::vector<std::pair<const TreeNode*, int>> pending;
+    if (root) pending.push_back(std::make_pair(root.get(), 1));
+
+    while (!pending.empty()) {
+        std::pair<const TreeNode*, int> current = pending.back();
+        pending.pop_back();
+        height = std::max(height, current.second);
+
+        if (current.first->left) pending.push_back(std::make_pair(current.first->left.get(), current.second + 1));
+        if (current.first->right) pending.push_back(std::make_pair(current.first->right.get(), current.second + 1));
+    }
+    return height;
+}
+
+#endif // PERSISTENTREDBLACKTREE_H
@@ -1,14 +1,76 @@
-#ifndef REDBLACKTREE_H
+﻿#ifndef REDBLACKTREE_H
 #define REDBLACKTREE_H
 
 #include "BinaryTree.h"
+#include "NodeAllocator.h"
+#include "FrozenTree.h"
+#include "TreeFormat.h"
+#include "TreeRenderer.h"
+#include "TreeStats.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+
+// Размер поддерева хранится в узле, только если включена порядковая статистика
+template <bool Enabled>
+struct SubtreeSize {
+    size_t size = 1;
+};
+
+template <>
+struct SubtreeSize<false> {};
+
+// Что делать с повтором уже имеющегося значения:
+//   Reject — не вставлять;
+//   Multiset — вставить отдельным узлом (правее равных);
+//   Counted — увеличить кратность найденного узла, память растёт с числом различных значений
+enum class DuplicatePolicy {
+    Reject,
+    Multiset,
+    Counted
+};
+
+// Первое нарушение, которое нашёл RedBlackTree::validate()
+enum class TreeViolation {
+    None,
+    RedRoot,
+    RedRed,       // у красного узла красный ребёнок
+    BlackHeight,  // пути от узла вниз содержат разное число чёрных узлов
+    BrokenParent, // parent ребёнка не указывает на его родителя
+    Unordered,    // симметричный обход не упорядочен (при Reject и Counted — есть повтор)
+    WrongSize,    // размер поддерева в узле неверен (OrderStatistics)
+    WrongCount    // size() не равен числу значений, или кратность узла нулевая
+};
+
+// Кратность значения хранится в узле только при DuplicatePolicy::Counted
+template <bool Enabled>
+struct NodeMultiplicity {
+    size_t count = 1;
+};
+
+template <>
+struct NodeMultiplicity<false> {};
 
 template <typename T>
+class ConcurrentRedBlackTree;
+
+// OrderStatistics = true добавляет в узлы размеры поддеревьев
+// и открывает rank, select и countInRange за O(log n).
+// При Counted размеры, size(), обходы и итераторы учитывают кратность:
+// значение с кратностью k встречается в них k раз
+template <typename T, template <typename> class NodeAllocator = PoolAllocator, bool OrderStatistics = false,
+          DuplicatePolicy Duplicates = DuplicatePolicy::Multiset>
 class RedBlackTree {
 private:
+    // Оптимистичным читателям нужен прямой доступ к узлам и аллокатору
+    template <typename> friend class ConcurrentRedBlackTree;
+
     enum Color { RED, BLACK };
 
-    struct TreeNode {
+    struct TreeNode : SubtreeSize<OrderStatistics>, NodeMultiplicity<Duplicates == DuplicatePolicy::Counted> {
         T value;
         TreeNode* left;
         TreeNode* right;
@@ -18,135 +80,533 @@ private:
         TreeNode(const T& value);
     };
 
-    TreeNode* root;
+    // Сколько поисков searchBatch ведёт одновременно
+    static constexpr size_t batchGroup = 16;
 
+    TreeNode* root;
+    NodeAllocator<TreeNode> allocator;
+    size_t nodeCount; // число значений; при Counted узлов может быть меньше
+
+    static size_t multiplicity(const TreeNode* node);
+    static size_t subtreeSize(const TreeNode* node);
+    static void updateSize(TreeNode* node);
+    static void growPath(TreeNode* node);
+    static void shrinkPath(TreeNode* node);
+    static void resizePath(TreeNode* node);
+    static void storeLink(TreeNode*& link, TreeNode* node);
+    static size_t destroySubtree(TreeNode* node, NodeAllocator<TreeNode>& from);
+    static void releaseTree(TreeNode* node, NodeAllocator<TreeNode>& from);
+    size_t countBelow(const T& value, bool inclusive) const;
+    static const TreeNode* leftmost(const TreeNode* node);
+    static const TreeNode* rightmost(const TreeNode* node);
+    static const TreeNode* successor(const TreeNode* node);
+    static const TreeNode* predecessor(const TreeNode* node);
     void rotateLeft(TreeNode* x);
     void rotateRight(TreeNode* x);
     void fixInsert(TreeNode* TreeNode);
-    void printSecond(TreeNode* root, int level = 0, bool isRight = false) const;
+
+    // Отсоединённое поддерево (parent корня — nullptr) и число чёрных узлов
+    // на любом пути от его корня вниз, включая корень
+    struct Subtree {
+        TreeNode* root;
+        int blackHeight;
+    };
+
+    // Меньше этого операции над множествами идут в одном потоке
+    static const size_t minParallelNodes = 1 << 15;
+    // Пакет, больший дерева хотя бы во столько раз, сливается с ним и пересобирает его.
+    // Меньшие пакеты отсортированным проходом вставляются не медленнее слияния
+    static const size_t batchRebuildRatio = 2;
+
+    static bool isRed(const TreeNode* node);
+    static void paint(TreeNode* node, Color color);
+    static int blackHeight(const TreeNode* node);
+    Subtree detachRoot();
+    void attachRoot(Subtree tree, size_t count);
+    static Subtree detachChild(const Subtree& tree, bool left);
+    static TreeNode* rotateLeftAt(TreeNode* pivotNode);
+    static TreeNode* rotateRightAt(TreeNode* pivotNode);
+    static Subtree joinRight(Subtree left, TreeNode* key, Subtree right);
+    static Subtree joinLeft(Subtree left, TreeNode* key, Subtree right);
+    static Subtree joinTrees(Subtree left, TreeNode* key, Subtree right);
+    static Subtree joinTrees(Subtree left, Subtree right);
+    static Subtree splitLast(Subtree tree, TreeNode*& last);
+    template <typename GoesLeft>
+    static void splitTree(Subtree tree, GoesLeft goesLeft, Subtree& left, Subtree& right);
+    static int forkDepth(size_t nodes, ThreadPool& pool);
+    template <typename Left, typename Right>
+    static void fork(ThreadPool& pool, int depth, Left left, Right right);
+    static Subtree unionTrees(Subtree a, Subtree b, ThreadPool& pool, int depth);
+    static Subtree intersectTrees(Subtree a, const TreeNode* b, std::vector<TreeNode*>& discarded, ThreadPool& pool, int depth);
+    static Subtree differenceTrees(Subtree a, const TreeNode* b, std::vector<TreeNode*>& discarded, ThreadPool& pool, int depth);
+    void searchGroup(const T* keys, size_t count, TreeNode** nodes) const;
+    static TreeNode* climbFrom(TreeNode* finger, const T& value);
+    void eraseNode(TreeNode* nodeToDelete);
+    void collectNodes(std::vector<TreeNode*>& nodes) const;
+    void insertSorted(const T* values, size_t count);
+    size_t eraseSorted(const T* values, size_t count);
+    TreeNode* linkBalanced(TreeNode** nodes, size_t count, TreeNode* parent, int depth, int redDepth);
+    void linkBalanced(TreeNode** nodes, size_t count);
+    template <typename Visit>
+    static void visitNodesPreOrder(TreeNode* start, Visit visit);
+    template <typename Visit>
+    static void visitNodesPostOrder(TreeNode* start, Visit visit);
+    template <typename Walk>
+    void walkForSave(Walk emit) const;
+    template <typename Visit>
+    void reverseInOrder(const TreeNode* start, int level, bool isRight, Visit visit) const;
+    bool renderFrom(const TreeNode* node, OutputBuffer& out, const RenderOptions& options) const;
 
 public:
+    // Двунаправленный итератор симметричного обхода: ходит по указателям parent,
+    // поэтому не требует памяти. end() хранит nullptr, --end() даёт наибольший элемент
+    class const_iterator {
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const T* pointer;
+        typedef const T& reference;
+
+        const_iterator() : node(nullptr), tree(nullptr), copy(0) {}
+
+        reference operator*() const { return node->value; }
+        pointer operator->() const { return &node->value; }
+
+        const_iterator& operator++()
+        {
+            if (copy + 1 < multiplicity(node)) {
+                copy++;
+            }
+            else {
+                node = successor(node);
+                copy = 0;
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int)
+        {
+            const_iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        const_iterator& operator--()
+        {
+            if (node && copy > 0) {
+                copy--;
+            }
+            else {
+                node = node ? predecessor(node) : rightmost(tree->root);
+                copy = node ? multiplicity(node) - 1 : 0;
+            }
+            return *this;
+        }
+
+        const_iterator operator--(int)
+        {
+            const_iterator previous = *this;
+            --*this;
+            return previous;
+        }
+
+        bool operator==(const const_iterator& other) const { return node == other.node && copy == other.copy; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+
+    private:
+        friend class RedBlackTree;
+
+        const TreeNode* node;
+        const RedBlackTree* tree;
+        size_t copy; // номер повтора значения узла, при Counted
+
+        const_iterator(const TreeNode* node, const RedBlackTree* tree) : node(node), tree(tree), copy(0) {}
+    };
+
+    // Значения в дереве менять нельзя: это нарушило бы порядок
+    typedef const_iterator iterator;
+
     RedBlackTree();
     RedBlackTree(const std::vector<T>& data);
     ~RedBlackTree();
 
+    RedBlackTree(const RedBlackTree&) = delete;
+    RedBlackTree& operator=(const RedBlackTree&) = delete;
+
     bool empty() const;
-    void deleteTree(const TreeNode* node) const;
+    size_t size() const;
+    void clear();
+    void deleteTree(TreeNode* node);
     void buildTree(const std::vector<T>& data);
-    void insert(const T& value);
+    void bulkLoad(const std::vector<T>& data);
+    // false, если значение отвергнуто политикой Reject
+    bool insert(const T& value);
+    const_iterator begin() const;
+    const_iterator end() const;
+    const_iterator find(const T& value) const;
+    const_iterator lower_bound(const T& value) const;
+    const_iterator upper_bound(const T& value) const;
+    std::pair<const_iterator, const_iterator> equal_range(const T& value) const;
+    size_t count(const T& value) const;
+    template <typename Visit>
+    void visitPreOrder(Visit visit) const;
+    template <typename Visit>
+    void visitPostOrder(Visit visit) const;
+    template <typename Visit>
+    void visitBreadthFirst(Visit visit) const;
     std::vector<T> inOrder() const;
     std::vector<T> preOrder() const;
     std::vector<T> postOrder() const;
     std::vector<T> breadthFirstTraversal() const;
     TreeNode* search(const T& value) const;
+    void searchBatch(const T* keys, size_t count, TreeNode** nodes) const;
+    void searchBatch(const T* keys, size_t count, bool* found) const;
+    FrozenTree<T> freeze() const;
+    FormatError save(std::ostream& out) const;
+    void save(std::vector<char>& buffer) const;
+    FormatError saveFile(const std::string& path) const;
+    FormatError load(const char* data, size_t size);
+    FormatError load(std::istream& input);
+    FormatError loadFile(const std::string& path);
+    size_t rank(const T& value) const;
+    TreeNode* select(size_t index) const;
+    size_t countInRange(const T& low, const T& high) const;
+    // Проверка всех инвариантов за O(n) без рекурсии: для тестов и отладки балансировки
+    TreeViolation validate() const;
     bool deleteNode(const T& value);
+    // Пакетные вставка и удаление: пакет сортируется, и каждый следующий ключ ищется
+    // не от корня, а подъёмом от места предыдущего — O(k log(n/k)) спусков вместо O(k log n).
+    // Пакет, который больше дерева, сливается с ним за O(n + k) и дерево собирается заново.
+    // eraseBatch удаляет по одному узлу на каждое вхождение ключа и возвращает число удалённых
+    void insertBatch(const std::vector<T>& values);
+    size_t eraseBatch(const std::vector<T>& values);
+    // Операции над множествами через join и split (Blelloch, Ferizovic, Sun, «Just Join
+    // for Parallel Ordered Sets»): O(m log(n/m + 1)) работы, где m — размер меньшего дерева.
+    // Все значения right не меньше значений этого дерева; узлы right переходят сюда
+    void join(RedBlackTree& right);
+    // Значения, не меньшие key, переходят в right. Узлы пула нельзя передать по одному,
+    // поэтому правая часть копируется: O(log n + размер правой части)
+    void split(const T& key, RedBlackTree& right);
+    // Все значения other добавляются в дерево, other остаётся пустым (повторы сохраняются)
+    void unionWith(RedBlackTree& other, ThreadPool& pool = ThreadPool::shared());
+    // Остаются значения, которые есть в other
+    void intersect(const RedBlackTree& other, ThreadPool& pool = ThreadPool::shared());
+    // Остаются значения, которых нет в other
+    void difference(const RedBlackTree& other, ThreadPool& pool = ThreadPool::shared());
     void transplant(TreeNode* u, TreeNode* v);
-    void fixDelete(TreeNode* x);
+    void fixDelete(TreeNode* x, TreeNode* xParent);
     int getHeight(const TreeNode* root) const;
-    std::vector<T> countNodesAtEachLevel(TreeNode* root) const;
+    int getHeight() const;
+    // false, если в дереве нет поддерева по пути options.path
+    bool render(OutputBuffer& out, const RenderOptions& options = RenderOptions()) const;
+    // То же для поддерева с корнем в узле со значением from (путь отсчитывается от него)
+    bool render(OutputBuffer& out, const RenderOptions& options, const T& from) const;
+    // Вывод в stdout: print — сверху вниз, printSecond — боком
     void print() const;
     void printSecond();
 };
 
-template <typename T>
-RedBlackTree<T>::TreeNode::TreeNode(const T& value)
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::TreeNode::TreeNode(const T& value)
     : value(value), left(nullptr), right(nullptr), parent(nullptr), color(RED) {}
 
-template <typename T>
-RedBlackTree<T>::RedBlackTree() : root(nullptr) {}
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::RedBlackTree() : root(nullptr), nodeCount(0) {}
 
-template <typename T>
-RedBlackTree<T>::RedBlackTree(const std::vector<T>& data) 
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::RedBlackTree(const std::vector<T>& data) : root(nullptr), nodeCount(0)
 {
-    for (auto it = data.rbegin(); it != data.rend(); ++it) {
-        insert(*it);
-    }
+    bulkLoad(data);
 }
 
-template<typename T>
-inline RedBlackTree<T>::~RedBlackTree()
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+inline RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::~RedBlackTree()
 {
-    deleteTree(root);
+    clear();
 }
 
-template <typename T>
-bool RedBlackTree<T>::empty() const
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+bool RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::empty() const
 {
     return root == nullptr;
 }
 
-template <typename T>
-void RedBlackTree<T>::deleteTree(const TreeNode* node) const {
-    if (!node) return;
-    deleteTree(node->left);
-    deleteTree(node->right);
-    delete node;
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+size_t RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::size() const
+{
+    return nodeCount;
 }
 
-template <typename T>
-void RedBlackTree<T>::buildTree(const std::vector<T>& data) 
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+size_t RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::multiplicity(const TreeNode* node)
+{
+    if constexpr (Duplicates == DuplicatePolicy::Counted) {
+        return node->count;
+    }
+    else {
+        return 1;
+    }
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+size_t RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::subtreeSize(const TreeNode* node)
+{
+    return node ? node->size : 0;
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::updateSize(TreeNode* node)
+{
+    if constexpr (OrderStatistics) {
+        node->size = subtreeSize(node->left) + subtreeSize(node->right) + multiplicity(node);
+    }
+}
+
+// Значение добавлено в node или под ним: размеры на пути к корню растут на 1
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::growPath(TreeNode* node)
+{
+    if constexpr (OrderStatistics) {
+        for (; node; node = node->parent) {
+            node->size++;
+        }
+    }
+}
+
+// Значение убрано из node или из-под него: размеры на пути к корню уменьшаются на 1
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::shrinkPath(TreeNode* node)
+{
+    if constexpr (OrderStatistics) {
+        for (; node; node = node->parent) {
+            node->size--;
+        }
+    }
+}
+
+// Пересчитывает размеры от node до корня, когда дети на пути уже верны
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::resizePath(TreeNode* node)
+{
+    if constexpr (OrderStatistics) {
+        for (; node; node = node->parent) {
+            updateSize(node);
+        }
+    }
+}
+
+// Ссылки left, right и root, по которым спускаются читатели ConcurrentRedBlackTree без
+// блокировок (аллокатор с concurrentReaders), пишутся атомарно с release: читатель,
+// увидевший узел, видит и его значение. parent и color читает только писатель.
+// С остальными аллокаторами это обычное присваивание
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::storeLink(TreeNode*& link, TreeNode* node)
+{
+    if constexpr (NodeAllocator<TreeNode>::concurrentReaders) {
+#if defined(_MSC_VER)
+        std::atomic_thread_fence(std::memory_order_release);
+        *static_cast<TreeNode* volatile*>(&link) = node;
+#else
+        __atomic_store_n(&link, node, __ATOMIC_RELEASE);
+#endif
+    }
+    else {
+        link = node;
+    }
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::clear()
+{
+    // Дерево сначала отцепляется, чтобы новые спуски читателей его уже не видели
+    TreeNode* oldRoot = root;
+    storeLink(root, nullptr);
+    nodeCount = 0;
+    releaseTree(oldRoot, allocator);
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::releaseTree(TreeNode* node, NodeAllocator<TreeNode>& from)
+{
+    // Пул освобождает все узлы блоками, без обхода дерева
+    if (NodeAllocator<TreeNode>::releasesInBulk && std::is_trivially_destructible<T>::value) {
+        from.release();
+    }
+    else {
+        destroySubtree(node, from);
+        from.release();
+    }
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::deleteTree(TreeNode* node) {
+    destroySubtree(node, allocator);
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+size_t RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::destroySubtree(TreeNode* node, NodeAllocator<TreeNode>& from)
+{
+    // Без рекурсии: левые поддеревья поворотами перекладываются в правую цепочку
+    size_t destroyed = 0;
+    while (node) {
+        if (node->left) {
+            TreeNode* leftChild = node->left;
+            storeLink(node->left, leftChild->right);
+            storeLink(leftChild->right, node);
+            node = leftChild;
+        }
+        else {
+            TreeNode* next = node->right;
+            from.destroy(node);
+            node = next;
+            destroyed++;
+        }
+    }
+    return destroyed;
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::buildTree(const std::vector<T>& data) 
 {
-    deleteTree(root);
+    clear();
 
     for (auto it = data.rbegin(); it != data.rend(); ++it) {
         insert(*it);
     }
 }
 
-template <typename T>
-void RedBlackTree<T>::rotateLeft(TreeNode* pivotNode) 
+// Построение за O(n) без поворотов: данные сортируются (если ещё не отсортированы),
+// а дерево собирается идеально сбалансированным
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::bulkLoad(const std::vector<T>& data)
+{
+    clear();
+    if (data.empty()) return;
+
+    std::vector<T> sorted;
+    const std::vector<T>* source = &data;
+    if (!std::is_sorted(data.begin(), data.end())) {
+        sorted = data;
+        std::sort(sorted.begin(), sorted.end());
+        source = &sorted;
+    }
+
+    std::vector<TreeNode*> nodes;
+    nodes.reserve(source->size());
+    nodeCount = 0;
+    for (const T& value : *source) {
+        // Равные значения идут подряд: повтор либо отбрасывается, либо прибавляется к кратности
+        if constexpr (Duplicates != DuplicatePolicy::Multiset) {
+            if (!nodes.empty() && !(nodes.back()->value < value)) {
+                if constexpr (Duplicates == DuplicatePolicy::Counted) {
+                    nodes.back()->count++;
+                    nodeCount++;
+                }
+                continue;
+            }
+        }
+        nodes.push_back(allocator.create(value));
+        nodeCount++;
+    }
+
+    linkBalanced(nodes.data(), nodes.size());
+}
+
+// Связывает отсортированные узлы в сбалансированное дерево и делает его корнем.
+// Все листья лежат на двух последних уровнях, поэтому если нижний уровень
+// заполнен не полностью, его узлы красятся в красный, остальные — в чёрный
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::linkBalanced(TreeNode** nodes, size_t count)
+{
+    int height = 0;
+    while ((size_t(1) << height) - 1 < count) {
+        height++;
+    }
+
+    int redDepth = ((size_t(1) << height) - 1 == count) ? -1 : height - 1;
+    storeLink(root, linkBalanced(nodes, count, nullptr, 0, redDepth));
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::TreeNode* RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::linkBalanced(TreeNode** nodes, size_t count, TreeNode* parent, int depth, int redDepth)
+{
+    if (count == 0) return nullptr;
+
+    size_t middle = count / 2;
+    TreeNode* node = nodes[middle];
+    node->parent = parent;
+    node->color = (depth == redDepth) ? RED : BLACK;
+    node->left = linkBalanced(nodes, middle, node, depth + 1, redDepth);
+    node->right = linkBalanced(nodes + middle + 1, count - middle - 1, node, depth + 1, redDepth);
+    updateSize(node);
+
+    return node;
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::rotateLeft(TreeNode* pivotNode) 
 {
     TreeNode* newParent = pivotNode->right;
-    pivotNode->right = newParent->left;
+    storeLink(pivotNode->right, newParent->left);
 
     if (newParent->left) newParent->left->parent = pivotNode;
 
     newParent->parent = pivotNode->parent;
 
-    if (!pivotNode->parent) //  pivotNode  
-        root = newParent;   //     newParent
-    else if (pivotNode == pivotNode->parent->left) //  pivotNode   
-        pivotNode->parent->left = newParent; //      newParent
+    if (!pivotNode->parent) // Если pivotNode был корнем
+        storeLink(root, newParent);   // Новый корень — это newParent
+    else if (pivotNode == pivotNode->parent->left) // Если pivotNode был левым ребёнком
+        storeLink(pivotNode->parent->left, newParent); // Новый левый ребёнок — это newParent
     else
-        pivotNode->parent->right = newParent; //      newParent
+        storeLink(pivotNode->parent->right, newParent); // Новый правый ребёнок — это newParent
 
-    newParent->left = pivotNode; // pivotNode    newParent
-    pivotNode->parent = newParent; //   pivotNode  newParent
+    storeLink(newParent->left, pivotNode); // pivotNode становится левым ребёнком newParent
+    pivotNode->parent = newParent; // Обновляем родителя pivotNode на newParent
+
+    updateSize(pivotNode);
+    updateSize(newParent);
+    TREE_STAT(rotations);
 }
 
 
-template <typename T>
-void RedBlackTree<T>::rotateRight(TreeNode* pivotNode) {
-    TreeNode* leftChild = pivotNode->left; //   pivotNode
-    pivotNode->left = leftChild->right;    //    leftChild     pivotNode
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::rotateRight(TreeNode* pivotNode) {
+    TreeNode* leftChild = pivotNode->left; // Левый потомок pivotNode
+    storeLink(pivotNode->left, leftChild->right);    // Переместить правое поддерево leftChild на место левого поддерева pivotNode
 
     if (leftChild->right) {
-        leftChild->right->parent = pivotNode; //     leftChild
+        leftChild->right->parent = pivotNode; // Обновить родителя правого поддерева leftChild
     }
 
-    leftChild->parent = pivotNode->parent; //     leftChild
+    leftChild->parent = pivotNode->parent; // Установить нового родителя для leftChild
 
-    //  pivotNode   
+    // Если pivotNode является корнем дерева
     if (!pivotNode->parent) {
-        root = leftChild;
+        storeLink(root, leftChild);
     }
-    //  pivotNode     
+    // Если pivotNode был правым потомком своего родителя
     else if (pivotNode == pivotNode->parent->right) {
-        pivotNode->parent->right = leftChild;
+        storeLink(pivotNode->parent->right, leftChild);
     }
-    //  pivotNode     
+    // Если pivotNode был левым потомком своего родителя
     else {
-        pivotNode->parent->left = leftChild;
+        storeLink(pivotNode->parent->left, leftChild);
     }
 
-    leftChild->right = pivotNode; //  pivotNode     leftChild
-    pivotNode->parent = leftChild; //   pivotNode
+    storeLink(leftChild->right, pivotNode); // Установить pivotNode в качестве правого потомка leftChild
+    pivotNode->parent = leftChild; // Обновить родителя pivotNode
+
+    updateSize(pivotNode);
+    updateSize(leftChild);
+    TREE_STAT(rotations);
 }
 
-template <typename T>
-void RedBlackTree<T>::fixInsert(TreeNode* currentNode) 
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::fixInsert(TreeNode* currentNode) 
 {
     while (currentNode != root && currentNode->parent->color == RED) {
+        TREE_STAT(insertFixups);
         TreeNode* parentNode = currentNode->parent;
         TreeNode* grandparentNode = parentNode->parent;
 
@@ -154,19 +614,20 @@ void RedBlackTree<T>::fixInsert(TreeNode* currentNode)
             TreeNode* uncleNode = grandparentNode->right;
 
             if (uncleNode && uncleNode->color == RED) {
-                parentNode->color = BLACK;
-                uncleNode->color = BLACK;
-                grandparentNode->color = RED;
+                paint(parentNode, BLACK);
+                paint(uncleNode, BLACK);
+                paint(grandparentNode, RED);
                 currentNode = grandparentNode;
             }
             else {
                 if (currentNode == parentNode->right) {
                     currentNode = parentNode;
                     rotateLeft(currentNode);
+                    parentNode = currentNode->parent;
                 }
 
-                parentNode->color = BLACK;
-                grandparentNode->color = RED;
+                paint(parentNode, BLACK);
+                paint(grandparentNode, RED);
                 rotateRight(grandparentNode);
             }
         }
@@ -175,137 +636,331 @@ void RedBlackTree<T>::fixInsert(TreeNode* currentNode)
             TreeNode* uncleNode = grandparentNode->left;
 
             if (uncleNode && uncleNode->color == RED) {
-                parentNode->color = BLACK;
-                uncleNode->color = BLACK;
-                grandparentNode->color = RED;
+                paint(parentNode, BLACK);
+                paint(uncleNode, BLACK);
+                paint(grandparentNode, RED);
                 currentNode = grandparentNode;
             }
             else {
                 if (currentNode == parentNode->left) {
                     currentNode = parentNode;
                     rotateRight(currentNode);
+                    parentNode = currentNode->parent;
                 }
-                parentNode->color = BLACK;
-                grandparentNode->color = RED;
+                paint(parentNode, BLACK);
+                paint(grandparentNode, RED);
                 rotateLeft(grandparentNode);
             }
         }
     }
 
-    root->color = BLACK;
+    paint(root, BLACK);
 }
 
-template <typename T>
-void RedBlackTree<T>::insert(const T& value) 
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+bool RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::insert(const T& value) 
 {
-    TreeNode* newNode = new TreeNode(value);
     if (!root) {
-        root = newNode;
-        root->color = BLACK;
-        return;
+        TreeNode* newRoot = allocator.create(value);
+        newRoot->color = BLACK;
+        storeLink(root, newRoot);
+        nodeCount++;
+        return true;
     }
 
     TreeNode* current = root;
     TreeNode* parent = nullptr;
 
-    while (current) {
-        parent = current;
-        if (value < current->value)
-            current = current->left;
-        else
-            current = current->right;
+    if constexpr (Duplicates == DuplicatePolicy::Multiset) {
+        while (current) {
+            parent = current;
+            if constexpr (OrderStatistics) {
+                current->size++; // новый узел окажется в поддереве current
+            }
+            if (value < current->value)
+                current = current->left;
+            else
+                current = current->right;
+        }
+    }
+    else {
+        // Повтор может найтись посреди спуска, поэтому размеры растут уже после него
+        while (current) {
+            parent = current;
+            if (value < current->value) {
+                current = current->left;
+            }
+            else if (current->value < value) {
+                current = current->right;
+            }
+            else {
+                if constexpr (Duplicates == DuplicatePolicy::Reject) {
+                    return false;
+                }
+                else {
+                    current->count++;
+                    nodeCount++;
+                    growPath(current);
+                    return true;
+                }
+            }
+        }
     }
 
+    TreeNode* newNode = allocator.create(value);
+    nodeCount++;
     newNode->parent = parent;
     if (value < parent->value)
-        parent->left = newNode;
+        storeLink(parent->left, newNode);
     else
-        parent->right = newNode;
+        storeLink(parent->right, newNode);
+
+    if constexpr (Duplicates != DuplicatePolicy::Multiset) {
+        growPath(parent);
+    }
 
     fixInsert(newNode);
+    return true;
 }
 
-template <typename T>
-std::vector<T> RedBlackTree<T>::inOrder() const 
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+const typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::TreeNode* RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::leftmost(const TreeNode* node)
 {
-    std::vector<T> res;
-    std::stack<TreeNode*> stack;
-    TreeNode* current = root;
-
-    while (current != nullptr || !stack.empty()) {
-        while (current != nullptr) {
-            stack.push(current);
-            current = current->left;
-        }
+    if (node) {
+        while (node->left) node = node->left;
+    }
+    return node;
+}
 
-        current = stack.top();
-        stack.pop();
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+const typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::TreeNode* RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::rightmost(const TreeNode* node)
+{
+    if (node) {
+        while (node->right) node = node->right;
+    }
+    return node;
+}
 
-        res.push_back(current->value);
+// Следующий по порядку узел: самый левый в правом поддереве
+// или первый предок, в левом поддереве которого лежит node
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+const typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::TreeNode* RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::successor(const TreeNode* node)
+{
+    if (node->right) return leftmost(node->right);
 
-        current = current->right;
+    while (node->parent && node == node->parent->right) {
+        node = node->parent;
     }
+    return node->parent;
+}
 
-    return res;
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+const typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::TreeNode* RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::predecessor(const TreeNode* node)
+{
+    if (node->left) return rightmost(node->left);
+
+    while (node->parent && node == node->parent->left) {
+        node = node->parent;
+    }
+    return node->parent;
 }
 
-template <typename T>
-std::vector<T> RedBlackTree<T>::preOrder() const 
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::const_iterator RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::begin() const
 {
-    std::vector<T> res;
-    if (root == nullptr) return res;
+    return const_iterator(leftmost(root), this);
+}
 
-    std::stack<TreeNode*> stack;
-    stack.push(root);
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::const_iterator RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::end() const
+{
+    return const_iterator(nullptr, this);
+}
 
-    while (!stack.empty()) {
-        TreeNode* current = stack.top();
-        stack.pop();
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::const_iterator RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::find(const T& value) const
+{
+    return const_iterator(search(value), this);
+}
 
-        res.push_back(current->value);
+// Первый элемент, не меньший value
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::const_iterator RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::lower_bound(const T& value) const
+{
+    const TreeNode* result = nullptr;
+    const TreeNode* node = root;
+    while (node) {
+        if (node->value < value) {
+            node = node->right;
+        }
+        else {
+            result = node;
+            node = node->left;
+        }
+    }
+    return const_iterator(result, this);
+}
 
-        if (current->right != nullptr)
-            stack.push(current->right);
-        if (current->left != nullptr)
-            stack.push(current->left);
+// Первый элемент, больший value
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::const_iterator RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::upper_bound(const T& value) const
+{
+    const TreeNode* result = nullptr;
+    const TreeNode* node = root;
+    while (node) {
+        if (value < node->value) {
+            result = node;
+            node = node->left;
+        }
+        else {
+            node = node->right;
+        }
     }
-    return res;
+    return const_iterator(result, this);
 }
 
-template <typename T>
-std::vector<T> RedBlackTree<T>::postOrder() const 
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+std::pair<typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::const_iterator, typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::const_iterator> RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::equal_range(const T& value) const
 {
-    std::vector<T> res;
-    if (root == nullptr) return res;
+    return std::make_pair(lower_bound(value), upper_bound(value));
+}
+
+// Сколько раз value встречается в дереве: при Reject и Counted это кратность
+// одного узла, при Multiset равные узлы пересчитываются по порядку
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+size_t RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::count(const T& value) const
+{
+    if constexpr (Duplicates != DuplicatePolicy::Multiset) {
+        const TreeNode* node = search(value);
+        return node ? multiplicity(node) : 0;
+    }
+    else {
+        size_t result = 0;
+        for (const_iterator it = lower_bound(value); it != end() && !(value < *it); ++it) {
+            result++;
+        }
+        return result;
+    }
+}
 
-    std::stack<TreeNode*> stack1, stack2;
-    stack1.push(root);
+// Прямой обход по указателям parent, visit(value) для каждого значения
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+template <typename Visit>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::visitPreOrder(Visit visit) const
+{
+    visitNodesPreOrder(root, [&visit](const TreeNode* node) {
+        for (size_t copy = multiplicity(node); copy; copy--) {
+            visit(node->value);
+        }
+    });
+}
 
-    while (!stack1.empty()) {
-        TreeNode* current = stack1.top();
-        stack1.pop();
-        stack2.push(current);
+// start — корень дерева (без родителя), visit(node) для каждого узла
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+template <typename Visit>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::visitNodesPreOrder(TreeNode* start, Visit visit)
+{
+    TreeNode* current = start;
+    while (current) {
+        visit(current);
 
-        if (current->left != nullptr)
-            stack1.push(current->left);
-        if (current->right != nullptr)
-            stack1.push(current->right);
+        if (current->left) {
+            current = current->left;
+        }
+        else if (current->right) {
+            current = current->right;
+        }
+        else {
+            // Поднимаемся, пока не найдётся непосещённое правое поддерево
+            while (current->parent && (current == current->parent->right || !current->parent->right)) {
+                current = current->parent;
+            }
+            current = current->parent ? current->parent->right : nullptr;
+        }
     }
+}
+
+// Обратный обход по указателям parent, visit(value) для каждого значения
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+template <typename Visit>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::visitPostOrder(Visit visit) const
+{
+    visitNodesPostOrder(root, [&visit](const TreeNode* node) {
+        for (size_t copy = multiplicity(node); copy; copy--) {
+            visit(node->value);
+        }
+    });
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+template <typename Visit>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::visitNodesPostOrder(TreeNode* start, Visit visit)
+{
+    TreeNode* current = start;
+    while (current) {
+        // Спуск к первому узлу поддерева в обратном порядке: влево, если можно, иначе вправо
+        while (current->left || current->right) {
+            current = current->left ? current->left : current->right;
+        }
+
+        while (true) {
+            visit(current);
 
-    while (!stack2.empty()) {
-        TreeNode* current = stack2.top();
-        stack2.pop();
-        res.push_back(current->value);
+            TreeNode* parent = current->parent;
+            if (!parent) return;
+
+            if (current == parent->left && parent->right) {
+                current = parent->right;
+                break;
+            }
+            current = parent;
+        }
     }
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+std::vector<T> RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::inOrder() const
+{
+    std::vector<T> res;
+    res.reserve(nodeCount);
+    res.assign(begin(), end());
     return res;
 }
 
-template <typename T>
-std::vector<T> RedBlackTree<T>::breadthFirstTraversal() const 
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+std::vector<T> RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::preOrder() const
+{
+    std::vector<T> res;
+    res.reserve(nodeCount);
+    visitPreOrder([&res](const T& value) { res.push_back(value); });
+    return res;
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+std::vector<T> RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::postOrder() const
+{
+    std::vector<T> res;
+    res.reserve(nodeCount);
+    visitPostOrder([&res](const T& value) { res.push_back(value); });
+    return res;
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+std::vector<T> RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::breadthFirstTraversal() const 
 {
     std::vector<T> res;
+    res.reserve(nodeCount);
+    visitBreadthFirst([&res](const T& value) { res.push_back(value); });
+    return res;
+}
+
+// Обход в ширину, visit(value) для каждого значения; в очереди узлы не более двух соседних уровней
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+template <typename Visit>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::visitBreadthFirst(Visit visit) const
+{
     if (!root) {
-        return res;
+        return;
     }
 
     std::queue<TreeNode*> nodeQueue;
@@ -315,7 +970,9 @@ std::vector<T> RedBlackTree<T>::breadthFirstTraversal() const
         TreeNode* currentNode = nodeQueue.front();
         nodeQueue.pop();
 
-        res.push_back(currentNode->value);
+        for (size_t copy = multiplicity(currentNode); copy; copy--) {
+            visit(currentNode->value);
+        }
 
         if (currentNode->left) {
             nodeQueue.push(currentNode->left);
@@ -324,16 +981,17 @@ std::vector<T> RedBlackTree<T>::breadthFirstTraversal() const
             nodeQueue.push(currentNode->right);
         }
     }
-
-    return res;
 }
 
-template <typename T>
-typename RedBlackTree<T>::TreeNode* RedBlackTree<T>::search(const T& value) const
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::TreeNode* RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::search(const T& value) const
 {
     TreeNode* node = root;
+    TREE_STAT_ONLY(size_t depth = 0;)
     while (node) {
+        TREE_STAT_ONLY(depth++;)
         if (value == node->value) {
+            TREE_STAT_HISTOGRAM(searchDepth, depth);
             return node;
         }
         if (value < node->value) {
@@ -343,15 +1001,358 @@ typename RedBlackTree<T>::TreeNode* RedBlackTree<T>::search(const T& value) cons
             node = node->right;
         }
     }
+    TREE_STAT_HISTOGRAM(searchDepth, depth);
     return nullptr;
 }
 
-template <typename T>
-bool RedBlackTree<T>::deleteNode(const T& value) {
-    TreeNode* nodeToDelete = search(value);
-    if (!nodeToDelete)
-        return false;
+// Пакетный поиск: nodes[i] = search(keys[i]).
+// Ключи обрабатываются группами: спуски группы делают по шагу по очереди,
+// и пока один ждёт загрузки узла из памяти, остальные продвигаются
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::searchBatch(const T* keys, size_t count, TreeNode** nodes) const
+{
+    for (size_t first = 0; first < count; first += batchGroup) {
+        searchGroup(keys + first, std::min(batchGroup, count - first), nodes + first);
+    }
+}
 
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::searchBatch(const T* keys, size_t count, bool* found) const
+{
+    TreeNode* nodes[batchGroup];
+    for (size_t first = 0; first < count; first += batchGroup) {
+        size_t groupSize = std::min(batchGroup, count - first);
+        searchGroup(keys + first, groupSize, nodes);
+        for (size_t i = 0; i < groupSize; i++) {
+            found[first + i] = nodes[i] != nullptr;
+        }
+    }
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::searchGroup(const T* keys, size_t count, TreeNode** nodes) const
+{
+    TreeNode* cursor[batchGroup];
+    for (size_t i = 0; i < count; i++) {
+        cursor[i] = root;
+        nodes[i] = nullptr;
+    }
+
+    // Спуски идут в ногу: на проходе depth каждый смотрит свой depth-й узел
+    TREE_STAT_ONLY(size_t depth = 0;)
+    bool active = root != nullptr;
+    while (active) {
+        active = false;
+        TREE_STAT_ONLY(depth++;)
+        for (size_t i = 0; i < count; i++) {
+            TreeNode* node = cursor[i];
+            if (!node) continue;
+
+            if (keys[i] == node->value) {
+                nodes[i] = node;
+                cursor[i] = nullptr;
+                TREE_STAT_HISTOGRAM(searchDepth, depth);
+                continue;
+            }
+
+            node = keys[i] < node->value ? node->left : node->right;
+            cursor[i] = node;
+            if (node) {
+                TREE_PREFETCH(node);
+                active = true;
+            }
+            else {
+                TREE_STAT_HISTOGRAM(searchDepth, depth);
+            }
+        }
+    }
+}
+
+// Снимок для чтения: дальнейшие изменения дерева на него не влияют
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+FrozenTree<T> RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::freeze() const
+{
+    return FrozenTree<T>(inOrder());
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+template <typename Walk>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::walkForSave(Walk emit) const
+{
+    static_assert(Duplicates != DuplicatePolicy::Counted, "RedBlackTree: the tree file format has no multiplicities");
+
+    visitNodesPreOrder(root, [&emit](const TreeNode* node) {
+        emit(node->left != nullptr, node->right != nullptr, node->color == BLACK, node->value);
+    });
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+FormatError RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::save(std::ostream& out) const
+{
+    return TreeFormat<T>::save(out, TreeKind::RedBlack, nodeCount, [this](auto emit) { walkForSave(emit); });
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::save(std::vector<char>& buffer) const
+{
+    TreeFormat<T>::save(buffer, TreeKind::RedBlack, nodeCount, [this](auto emit) { walkForSave(emit); });
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+FormatError RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::saveFile(const std::string& path) const
+{
+    return TreeFormat<T>::saveFile(path, TreeKind::RedBlack, nodeCount, [this](auto emit) { walkForSave(emit); });
+}
+
+// Дерево восстанавливается в прямом порядке без поворотов и сравнений со вставкой.
+// Файл проверяется: корень чёрный, у красного узла нет красных детей, на всех путях
+// до пустых ссылок поровну чёрных узлов, значения по порядку не убывают.
+// При ошибке текущее дерево не меняется
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+FormatError RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::load(const char* data, size_t size)
+{
+    static_assert(Duplicates != DuplicatePolicy::Counted, "RedBlackTree: the tree file format has no multiplicities");
+
+    typename TreeFormat<T>::Layout layout;
+    FormatError error = TreeFormat<T>::open(data, size, TreeKind::RedBlack, layout);
+    if (error != FormatError::None) return error;
+
+    const char* structure = data + layout.structure;
+    const char* colours = data + layout.colours;
+    const char* values = data + layout.values;
+
+    // Свободное место для следующего узла: сверху стека — левое место последнего узла
+    struct Slot {
+        TreeNode* parent;
+        TreeNode** link;
+        uint64_t blackDepth; // чёрных узлов на пути от корня до parent включительно
+    };
+
+    NodeAllocator<TreeNode> newAllocator;
+    TreeNode* newRoot = nullptr;
+    std::vector<Slot> slots;
+    if (layout.count) slots.push_back({ nullptr, &newRoot, 0 });
+    uint64_t blackHeight = 0;
+    bool leafSeen = false;
+
+    for (uint64_t i = 0; i < layout.count && error == FormatError::None; i++) {
+        if (slots.empty()) {
+            error = FormatError::CorruptStructure;
+            break;
+        }
+
+        Slot slot = slots.back();
+        slots.pop_back();
+        TreeNode* node = newAllocator.create(TreeFormat<T>::value(values, i));
+        node->parent = slot.parent;
+        node->color = TreeFormat<T>::bit(colours, i) ? BLACK : RED;
+        *slot.link = node;
+
+        if (node->color == RED && (!slot.parent || slot.parent->color == RED)) {
+            error = FormatError::CorruptStructure;
+        }
+
+        uint64_t depth = slot.blackDepth + (node->color == BLACK);
+        bool hasLeft = TreeFormat<T>::bit(structure, 2 * i);
+        bool hasRight = TreeFormat<T>::bit(structure, 2 * i + 1);
+        if (!hasLeft || !hasRight) {
+            if (leafSeen && depth != blackHeight) error = FormatError::CorruptStructure;
+            blackHeight = depth;
+            leafSeen = true;
+        }
+        if (hasRight) slots.push_back({ node, &node->right, depth });
+        if (hasLeft) slots.push_back({ node, &node->left, depth });
+    }
+    if (error == FormatError::None && !slots.empty()) {
+        error = FormatError::CorruptStructure;
+    }
+
+    if (error == FormatError::None && newRoot) {
+        for (const TreeNode* node = leftmost(newRoot), *next = successor(node); next; node = next, next = successor(node)) {
+            // При Reject повторов в файле быть не должно
+            bool unordered = (Duplicates == DuplicatePolicy::Reject) ? !(node->value < next->value) : next->value < node->value;
+            if (unordered) {
+                error = FormatError::Unordered;
+                break;
+            }
+        }
+    }
+
+    if (error != FormatError::None) {
+        // Недостроенное дерево связано правильно: пустые места остались nullptr
+        releaseTree(newRoot, newAllocator);
+        return error;
+    }
+
+    visitNodesPostOrder(newRoot, [](TreeNode* node) {
+        updateSize(node);
+    });
+
+    clear();
+    allocator.swap(newAllocator);
+    root = newRoot;
+    nodeCount = static_cast<size_t>(layout.count);
+    return FormatError::None;
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+FormatError RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::load(std::istream& input)
+{
+    std::vector<char> buffer;
+    FormatError error = TreeFormat<T>::readAll(input, buffer);
+    if (error != FormatError::None) return error;
+    return load(buffer.data(), buffer.size());
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+FormatError RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::loadFile(const std::string& path)
+{
+    return TreeFormat<T>::loadFile(path, [this](const char* data, size_t size) {
+        return load(data, size);
+    });
+}
+
+// Число значений меньше value (inclusive = false) или не больше value (inclusive = true)
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+size_t RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::countBelow(const T& value, bool inclusive) const
+{
+    static_assert(OrderStatistics, "RedBlackTree: rank/countInRange require OrderStatistics = true");
+
+    size_t count = 0;
+    TreeNode* node = root;
+    while (node) {
+        bool goRight = inclusive ? !(value < node->value) : node->value < value;
+        if (goRight) {
+            count += subtreeSize(node->left) + multiplicity(node);
+            node = node->right;
+        }
+        else {
+            node = node->left;
+        }
+    }
+    return count;
+}
+
+// Сколько значений в дереве строго меньше value
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+size_t RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::rank(const T& value) const
+{
+    return countBelow(value, false);
+}
+
+// Узел с index-м по порядку значением (с нуля) или nullptr, если index >= size()
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::TreeNode* RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::select(size_t index) const
+{
+    static_assert(OrderStatistics, "RedBlackTree: select requires OrderStatistics = true");
+
+    TreeNode* node = root;
+    while (node) {
+        size_t leftSize = subtreeSize(node->left);
+        if (index < leftSize) {
+            node = node->left;
+        }
+        else if (index < leftSize + multiplicity(node)) {
+            return node;
+        }
+        else {
+            index -= leftSize + multiplicity(node);
+            node = node->right;
+        }
+    }
+    return nullptr;
+}
+
+// Первый проход сверху вниз проверяет связи, цвета, чёрную высоту и размеры;
+// второй идёт по successor (связи уже проверены) и проверяет порядок.
+// Узлов не может быть больше nodeCount, поэтому цикл в указателях тоже обнаружится
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+TreeViolation RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::validate() const
+{
+    if (!root) return nodeCount == 0 ? TreeViolation::None : TreeViolation::WrongCount;
+    if (root->parent) return TreeViolation::BrokenParent;
+    if (root->color != BLACK) return TreeViolation::RedRoot;
+
+    struct Frame {
+        const TreeNode* node;
+        size_t blackDepth; // чёрных узлов от корня до node включительно
+    };
+
+    std::vector<Frame> stack;
+    stack.push_back({ root, 1 });
+    size_t leafDepth = 0;
+    size_t nodes = 0;
+    size_t values = 0;
+
+    while (!stack.empty()) {
+        Frame frame = stack.back();
+        stack.pop_back();
+        const TreeNode* node = frame.node;
+
+        if (++nodes > nodeCount) return TreeViolation::WrongCount;
+        if (multiplicity(node) == 0) return TreeViolation::WrongCount;
+        values += multiplicity(node);
+
+        if constexpr (OrderStatistics) {
+            if (node->size != subtreeSize(node->left) + subtreeSize(node->right) + multiplicity(node)) {
+                return TreeViolation::WrongSize;
+            }
+        }
+
+        const TreeNode* children[2] = { node->left, node->right };
+        for (const TreeNode* child : children) {
+            if (!child) {
+                // Пустой ребёнок завершает путь: все пути должны дать одну чёрную высоту
+                if (leafDepth == 0) leafDepth = frame.blackDepth;
+                if (frame.blackDepth != leafDepth) return TreeViolation::BlackHeight;
+                continue;
+            }
+            if (child->parent != node) return TreeViolation::BrokenParent;
+            if (node->color == RED && child->color == RED) return TreeViolation::RedRed;
+            stack.push_back({ child, frame.blackDepth + (child->color == BLACK) });
+        }
+    }
+
+    if (values != nodeCount) return TreeViolation::WrongCount;
+
+    for (const TreeNode* node = leftmost(root), *next = successor(node); next; node = next, next = successor(node)) {
+        bool unordered = (Duplicates == DuplicatePolicy::Multiset) ? next->value < node->value : !(node->value < next->value);
+        if (unordered) return TreeViolation::Unordered;
+    }
+
+    return TreeViolation::None;
+}
+
+// Сколько значений лежит в отрезке [low, high]
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+size_t RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::countInRange(const T& low, const T& high) const
+{
+    if (high < low) return 0;
+    return countBelow(high, true) - countBelow(low, false);
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+bool RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::deleteNode(const T& value) {
+    TreeNode* nodeToDelete = search(value);
+    if (!nodeToDelete)
+        return false;
+
+    if constexpr (Duplicates == DuplicatePolicy::Counted) {
+        if (nodeToDelete->count > 1) {
+            nodeToDelete->count--;
+            nodeCount--;
+            shrinkPath(nodeToDelete);
+            return true;
+        }
+    }
+
+    eraseNode(nodeToDelete);
+    return true;
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::eraseNode(TreeNode* nodeToDelete)
+{
     TreeNode* y = nodeToDelete;
     TreeNode* x = nullptr;
     TreeNode* xParent = nullptr;
@@ -359,10 +1360,12 @@ bool RedBlackTree<T>::deleteNode(const T& value) {
 
     if (!nodeToDelete->left) {
         x = nodeToDelete->right;
+        xParent = nodeToDelete->parent;
         transplant(nodeToDelete, nodeToDelete->right);
     }
     else if (!nodeToDelete->right) {
         x = nodeToDelete->left;
+        xParent = nodeToDelete->parent;
         transplant(nodeToDelete, nodeToDelete->left);
     }
     else {
@@ -376,229 +1379,904 @@ bool RedBlackTree<T>::deleteNode(const T& value) {
         x = y->right;
 
         if (y->parent == nodeToDelete) {
+            xParent = y;
             if (x) x->parent = y;
         }
         else {
+            xParent = y->parent;
             transplant(y, y->right);
-            y->right = nodeToDelete->right;
+            storeLink(y->right, nodeToDelete->right);
             y->right->parent = y;
         }
 
         transplant(nodeToDelete, y);
-        y->left = nodeToDelete->left;
+        storeLink(y->left, nodeToDelete->left);
         y->left->parent = y;
         y->color = nodeToDelete->color;
+        if constexpr (OrderStatistics) {
+            y->size = nodeToDelete->size;
+        }
     }
 
-    delete nodeToDelete;
+    // Узел физически исчез под xParent: поддеревья на пути к корню стали на 1 меньше.
+    // При Counted y переехал вместе со своей кратностью, и размеры пересчитываются
+    if constexpr (Duplicates == DuplicatePolicy::Counted) {
+        resizePath(xParent);
+    }
+    else {
+        shrinkPath(xParent);
+    }
+    nodeCount -= multiplicity(nodeToDelete);
+    allocator.destroy(nodeToDelete);
 
-    if (yOriginalColor == BLACK && x) {
-        fixDelete(x);
+    // x может быть пустым: тогда «двойной чёрный» висит на месте ребёнка xParent
+    if (yOriginalColor == BLACK) {
+        fixDelete(x, xParent);
     }
+}
 
-    return true;
+// Поднимается от finger, пока поддерево может не содержать место для value.
+// Все узлы левее finger не больше value, поэтому поддерево левого ребёнка p
+// подходит, как только value < p->value; иначе подходит только корень
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::TreeNode* RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::climbFrom(TreeNode* finger, const T& value)
+{
+    TreeNode* node = finger;
+    while (node->parent && !(node == node->parent->left && value < node->parent->value)) {
+        node = node->parent;
+    }
+    return node;
 }
 
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::collectNodes(std::vector<TreeNode*>& nodes) const
+{
+    nodes.reserve(nodes.size() + nodeCount);
+    for (const TreeNode* node = leftmost(root); node; node = successor(node)) {
+        nodes.push_back(const_cast<TreeNode*>(node));
+    }
+}
 
-template <typename T>
-void RedBlackTree<T>::transplant(TreeNode* u, TreeNode* v) {
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::insertBatch(const std::vector<T>& values)
+{
+    if (values.empty()) return;
+
+    if (std::is_sorted(values.begin(), values.end())) {
+        insertSorted(values.data(), values.size());
+    }
+    else {
+        std::vector<T> sorted(values);
+        std::sort(sorted.begin(), sorted.end());
+        insertSorted(sorted.data(), sorted.size());
+    }
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::insertSorted(const T* values, size_t count)
+{
+    if (count >= batchRebuildRatio * nodeCount) {
+        // Слияние: старые узлы идут раньше новых с тем же значением, как и при insert,
+        // поэтому повтор всегда сравнивается с последним добавленным узлом
+        std::vector<TreeNode*> existing;
+        collectNodes(existing);
+        std::vector<TreeNode*> nodes;
+        nodes.reserve(existing.size() + count);
+
+        auto append = [&](const T& value) {
+            if constexpr (Duplicates != DuplicatePolicy::Multiset) {
+                if (!nodes.empty() && !(nodes.back()->value < value)) {
+                    if constexpr (Duplicates == DuplicatePolicy::Counted) {
+                        nodes.back()->count++;
+                        nodeCount++;
+                    }
+                    return;
+                }
+            }
+            nodes.push_back(allocator.create(value));
+            nodeCount++;
+        };
+
+        size_t next = 0;
+        for (TreeNode* node : existing) {
+            while (next < count && values[next] < node->value) {
+                append(values[next++]);
+            }
+            nodes.push_back(node);
+        }
+        while (next < count) {
+            append(values[next++]);
+        }
+
+        linkBalanced(nodes.data(), nodes.size());
+        return;
+    }
+
+    TreeNode* finger = nullptr;
+    for (size_t i = 0; i < count; i++) {
+        const T& value = values[i];
+        if (!root) {
+            root = allocator.create(value);
+            root->color = BLACK;
+            nodeCount++;
+            finger = root;
+            continue;
+        }
+
+        // Равный узел при Reject и Counted единственный: либо finger, либо правее него
+        TreeNode* current = finger ? climbFrom(finger, value) : root;
+        TreeNode* parent = nullptr;
+        TreeNode* equal = nullptr;
+        while (current) {
+            parent = current;
+            if (value < current->value) {
+                current = current->left;
+            }
+            else if (Duplicates != DuplicatePolicy::Multiset && !(current->value < value)) {
+                equal = current;
+                break;
+            }
+            else {
+                current = current->right;
+            }
+        }
+
+        if (equal) {
+            if constexpr (Duplicates == DuplicatePolicy::Counted) {
+                equal->count++;
+                nodeCount++;
+                growPath(equal);
+            }
+            finger = equal;
+            continue;
+        }
+
+        TreeNode* newNode = allocator.create(value);
+        nodeCount++;
+        newNode->parent = parent;
+        if (value < parent->value)
+            parent->left = newNode;
+        else
+            parent->right = newNode;
+
+        growPath(parent);
+        fixInsert(newNode);
+        finger = newNode;
+    }
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+size_t RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::eraseBatch(const std::vector<T>& values)
+{
+    if (values.empty() || !root) return 0;
+
+    if (std::is_sorted(values.begin(), values.end())) {
+        return eraseSorted(values.data(), values.size());
+    }
+    std::vector<T> sorted(values);
+    std::sort(sorted.begin(), sorted.end());
+    return eraseSorted(sorted.data(), sorted.size());
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+size_t RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::eraseSorted(const T* values, size_t count)
+{
+    size_t before = nodeCount;
+
+    if (count >= batchRebuildRatio * nodeCount) {
+        // Узлы собираются заранее: successor нельзя звать через освобождённых предков
+        std::vector<TreeNode*> nodes;
+        collectNodes(nodes);
+
+        size_t kept = 0;
+        size_t next = 0;
+        for (TreeNode* node : nodes) {
+            while (next < count && values[next] < node->value) {
+                next++;
+            }
+            // Каждое вхождение ключа снимает одну копию значения
+            size_t removed = 0;
+            while (next < count && removed < multiplicity(node) && !(node->value < values[next])) {
+                next++;
+                removed++;
+            }
+            nodeCount -= removed;
+
+            if (removed == multiplicity(node)) {
+                allocator.destroy(node);
+                continue;
+            }
+            if constexpr (Duplicates == DuplicatePolicy::Counted) {
+                node->count -= removed;
+            }
+            nodes[kept++] = node;
+        }
+
+        linkBalanced(nodes.data(), kept);
+        return before - nodeCount;
+    }
+
+    // finger — следующий узел после удалённого: все узлы левее него меньше
+    // следующего ключа, если тот строго больше предыдущего. Повтор ключа ищется от корня
+    TreeNode* finger = nullptr;
+    for (size_t i = 0; i < count && root; i++) {
+        const T& value = values[i];
+        bool repeated = i > 0 && !(values[i - 1] < value);
+        TreeNode* node = (finger && !repeated) ? climbFrom(finger, value) : root;
+        while (node && (value < node->value || node->value < value)) {
+            node = (value < node->value) ? node->left : node->right;
+        }
+        if (!node) continue;
+
+        if constexpr (Duplicates == DuplicatePolicy::Counted) {
+            if (node->count > 1) {
+                node->count--;
+                nodeCount--;
+                shrinkPath(node);
+                finger = node;
+                continue;
+            }
+        }
+
+        finger = const_cast<TreeNode*>(successor(node));
+        eraseNode(node);
+    }
+
+    return before - nodeCount;
+}
+
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::transplant(TreeNode* u, TreeNode* v) {
     if (!u->parent)
-        root = v;
+        storeLink(root, v);
     else if (u == u->parent->left)
-        u->parent->left = v;
+        storeLink(u->parent->left, v);
     else
-        u->parent->right = v;
+        storeLink(u->parent->right, v);
 
     if (v)
         v->parent = u->parent;
 }
 
-template <typename T>
-void RedBlackTree<T>::fixDelete(TreeNode* x) {
-    while (x != root && x->color == BLACK) {
-        if (x == x->parent->left) {
-            TreeNode* sibling = x->parent->right;
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::fixDelete(TreeNode* x, TreeNode* xParent) {
+    while (x != root && (!x || x->color == BLACK)) {
+        TREE_STAT(deleteFixups);
+        if (x == xParent->left) {
+            TreeNode* sibling = xParent->right;
             if (sibling->color == RED) {
-                sibling->color = BLACK;
-                x->parent->color = RED;
-                rotateLeft(x->parent);
-                sibling = x->parent->right;
+                paint(sibling, BLACK);
+                paint(xParent, RED);
+                rotateLeft(xParent);
+                sibling = xParent->right;
             }
 
             if ((!sibling->left || sibling->left->color == BLACK) &&
                 (!sibling->right || sibling->right->color == BLACK)) {
-                sibling->color = RED;
-                x = x->parent;
+                paint(sibling, RED);
+                x = xParent;
+                xParent = x->parent;
             }
             else {
                 if (!sibling->right || sibling->right->color == BLACK) {
-                    if (sibling->left) sibling->left->color = BLACK;
-                    sibling->color = RED;
+                    if (sibling->left) paint(sibling->left, BLACK);
+                    paint(sibling, RED);
                     rotateRight(sibling);
-                    sibling = x->parent->right;
+                    sibling = xParent->right;
                 }
-                sibling->color = x->parent->color;
-                x->parent->color = BLACK;
-                if (sibling->right) sibling->right->color = BLACK;
-                rotateLeft(x->parent);
+                paint(sibling, xParent->color);
+                paint(xParent, BLACK);
+                if (sibling->right) paint(sibling->right, BLACK);
+                rotateLeft(xParent);
                 x = root;
             }
         }
         else {
-            TreeNode* sibling = x->parent->left;
+            TreeNode* sibling = xParent->left;
             if (sibling->color == RED) {
-                sibling->color = BLACK;
-                x->parent->color = RED;
-                rotateRight(x->parent);
-                sibling = x->parent->left;
+                paint(sibling, BLACK);
+                paint(xParent, RED);
+                rotateRight(xParent);
+                sibling = xParent->left;
             }
 
             if ((!sibling->right || sibling->right->color == BLACK) &&
                 (!sibling->left || sibling->left->color == BLACK)) {
-                sibling->color = RED;
-                x = x->parent;
+                paint(sibling, RED);
+                x = xParent;
+                xParent = x->parent;
             }
             else {
                 if (!sibling->left || sibling->left->color == BLACK) {
-                    if (sibling->right) sibling->right->color = BLACK;
-                    sibling->color = RED;
+                    if (sibling->right) paint(sibling->right, BLACK);
+                    paint(sibling, RED);
                     rotateLeft(sibling);
-                    sibling = x->parent->left;
+                    sibling = xParent->left;
                 }
-                sibling->color = x->parent->color;
-                x->parent->color = BLACK;
-                if (sibling->left) sibling->left->color = BLACK;
-                rotateRight(x->parent);
+                paint(sibling, xParent->color);
+                paint(xParent, BLACK);
+                if (sibling->left) paint(sibling->left, BLACK);
+                rotateRight(xParent);
                 x = root;
             }
         }
     }
 
-    x->color = BLACK;
+    if (x) paint(x, BLACK);
 }
 
-template <typename T>
-int RedBlackTree<T>::getHeight(const TreeNode* root) const {
-    if (root == nullptr) {
-        return 0;
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+bool RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::isRed(const TreeNode* node)
+{
+    return node && node->color == RED;
+}
+
+// Перекрашивание в балансировке; в статистику идут только настоящие смены цвета
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::paint(TreeNode* node, Color color)
+{
+    TREE_STAT_ONLY(if (node->color != color) TREE_STAT(recolorings);)
+    node->color = color;
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+int RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::blackHeight(const TreeNode* node)
+{
+    int height = 0;
+    for (; node; node = node->left) {
+        height += node->color == BLACK;
     }
+    return height;
+}
 
-    return 1 + max(getHeight(root->left), getHeight(root->right));
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::Subtree RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::detachRoot()
+{
+    Subtree tree = { root, blackHeight(root) };
+    root = nullptr;
+    nodeCount = 0;
+    return tree;
 }
 
-template <typename T>
-std::vector<T> RedBlackTree<T>::countNodesAtEachLevel(TreeNode* root) const
+// Корень результата перекрашивается в чёрный: у поддеревьев он мог остаться красным
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::attachRoot(Subtree tree, size_t count)
 {
-    std::vector<T> result;
+    root = tree.root;
+    nodeCount = count;
+    if (root) {
+        root->parent = nullptr;
+        root->color = BLACK;
+    }
+}
 
-    if (!root) return result;
+// Левый или правый ребёнок корня как отдельное поддерево. Сам корень не меняется:
+// его ссылки перезапишет join
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::Subtree RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::detachChild(const Subtree& tree, bool left)
+{
+    TreeNode* child = left ? tree.root->left : tree.root->right;
+    if (child) child->parent = nullptr;
+    return { child, tree.blackHeight - (tree.root->color == BLACK) };
+}
 
-    std::queue<TreeNode*> q;
-    q.push(root);
+// Повороты внутри отсоединённого поддерева: возвращают узел, вставший на место pivotNode
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::TreeNode* RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::rotateLeftAt(TreeNode* pivotNode)
+{
+    TreeNode* newParent = pivotNode->right;
+    pivotNode->right = newParent->left;
+    if (newParent->left) newParent->left->parent = pivotNode;
 
-    while (!q.empty()) {
-        int levelSize = q.size();
-        result.push_back(levelSize);
+    newParent->parent = pivotNode->parent;
+    if (pivotNode->parent) {
+        if (pivotNode == pivotNode->parent->left)
+            pivotNode->parent->left = newParent;
+        else
+            pivotNode->parent->right = newParent;
+    }
 
-        for (int i = 0; i < levelSize; ++i) {
-            TreeNode* node = q.front();
-            q.pop();
+    newParent->left = pivotNode;
+    pivotNode->parent = newParent;
 
-            if (node->left) q.push(node->left);
-            if (node->right) q.push(node->right);
-        }
+    updateSize(pivotNode);
+    updateSize(newParent);
+    TREE_STAT(rotations);
+    return newParent;
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::TreeNode* RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::rotateRightAt(TreeNode* pivotNode)
+{
+    TreeNode* leftChild = pivotNode->left;
+    pivotNode->left = leftChild->right;
+    if (leftChild->right) leftChild->right->parent = pivotNode;
+
+    leftChild->parent = pivotNode->parent;
+    if (pivotNode->parent) {
+        if (pivotNode == pivotNode->parent->right)
+            pivotNode->parent->right = leftChild;
+        else
+            pivotNode->parent->left = leftChild;
     }
 
-    return result;
+    leftChild->right = pivotNode;
+    pivotNode->parent = leftChild;
+
+    updateSize(pivotNode);
+    updateSize(leftChild);
+    TREE_STAT(rotations);
+    return leftChild;
 }
 
-template <typename T>
-void RedBlackTree<T>::print() const {
-    if (root == nullptr) {
+// left выше right: key с правым поддеревом right встаёт на правый край left,
+// на первый чёрный узел той же чёрной высоты. Красный key под красным родителем
+// чинится поворотом в деде, как в join Блеллоха, и конфликт поднимается вверх
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::Subtree RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::joinRight(Subtree left, TreeNode* key, Subtree right)
+{
+    TreeNode* parent = nullptr;
+    TreeNode* current = left.root;
+    int height = left.blackHeight;
+    while (height != right.blackHeight || isRed(current)) {
+        parent = current;
+        height -= current->color == BLACK;
+        current = current->right;
+    }
+
+    key->left = current;
+    key->right = right.root;
+    key->parent = parent;
+    key->color = RED;
+    if (current) current->parent = key;
+    if (right.root) right.root->parent = key;
+    parent->right = key;
+    updateSize(key);
+
+    TreeNode* node = key;
+    while (isRed(node->parent) && node->parent->parent) {
+        node->color = BLACK;
+        node = rotateLeftAt(node->parent->parent);
+    }
+    // Выше последнего поворота размеры поддеревьев выросли на вставленную часть
+    TreeNode* top = node;
+    for (; top->parent; top = top->parent) {
+        updateSize(top->parent);
+    }
+
+    if (isRed(top) && isRed(top->right)) {
+        top->color = BLACK;
+        return { top, left.blackHeight + 1 };
+    }
+    return { top, left.blackHeight };
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::Subtree RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::joinLeft(Subtree left, TreeNode* key, Subtree right)
+{
+    TreeNode* parent = nullptr;
+    TreeNode* current = right.root;
+    int height = right.blackHeight;
+    while (height != left.blackHeight || isRed(current)) {
+        parent = current;
+        height -= current->color == BLACK;
+        current = current->left;
+    }
+
+    key->left = left.root;
+    key->right = current;
+    key->parent = parent;
+    key->color = RED;
+    if (current) current->parent = key;
+    if (left.root) left.root->parent = key;
+    parent->left = key;
+    updateSize(key);
+
+    TreeNode* node = key;
+    while (isRed(node->parent) && node->parent->parent) {
+        node->color = BLACK;
+        node = rotateRightAt(node->parent->parent);
+    }
+    TreeNode* top = node;
+    for (; top->parent; top = top->parent) {
+        updateSize(top->parent);
+    }
+
+    if (isRed(top) && isRed(top->left)) {
+        top->color = BLACK;
+        return { top, right.blackHeight + 1 };
+    }
+    return { top, right.blackHeight };
+}
+
+// Дерево из left, key и right, где left <= key <= right: O(разности чёрных высот)
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::Subtree RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::joinTrees(Subtree left, TreeNode* key, Subtree right)
+{
+    // Красный корень поддерева можно перекрасить в чёрный, подняв чёрную высоту:
+    // тогда key не окажется красным над красным корнем
+    if (isRed(left.root)) {
+        left.root->color = BLACK;
+        left.blackHeight++;
+    }
+    if (isRed(right.root)) {
+        right.root->color = BLACK;
+        right.blackHeight++;
+    }
+
+    if (left.blackHeight > right.blackHeight) return joinRight(left, key, right);
+    if (right.blackHeight > left.blackHeight) return joinLeft(left, key, right);
+
+    key->left = left.root;
+    key->right = right.root;
+    key->parent = nullptr;
+    if (left.root) left.root->parent = key;
+    if (right.root) right.root->parent = key;
+    updateSize(key);
+
+    if (!isRed(left.root) && !isRed(right.root)) {
+        key->color = RED;
+        return { key, left.blackHeight };
+    }
+    key->color = BLACK;
+    return { key, left.blackHeight + 1 };
+}
+
+// Соединение без разделителя: им становится наибольший узел left
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::Subtree RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::joinTrees(Subtree left, Subtree right)
+{
+    if (!left.root) return right;
+    if (!right.root) return left;
+
+    TreeNode* last;
+    Subtree rest = splitLast(left, last);
+    return joinTrees(rest, last, right);
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::Subtree RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::splitLast(Subtree tree, TreeNode*& last)
+{
+    TreeNode* node = tree.root;
+    Subtree left = detachChild(tree, true);
+    Subtree right = detachChild(tree, false);
+    if (!right.root) {
+        last = node;
+        return left;
+    }
+
+    Subtree rest = splitLast(right, last);
+    return joinTrees(left, node, rest);
+}
+
+// Делит дерево на значения, для которых goesLeft истинно, и остальные.
+// goesLeft монотонно: истинно для всех значений меньше некоторой границы.
+// Глубина рекурсии — высота дерева
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+template <typename GoesLeft>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::splitTree(Subtree tree, GoesLeft goesLeft, Subtree& left, Subtree& right)
+{
+    if (!tree.root) {
+        left = right = { nullptr, 0 };
         return;
     }
 
-    int minSpace = 2;
-    int countSpace = minSpace * std::pow(2, getHeight(root) - 2);
+    TreeNode* node = tree.root;
+    Subtree nodeLeft = detachChild(tree, true);
+    Subtree nodeRight = detachChild(tree, false);
+    if (goesLeft(node->value)) {
+        Subtree middle;
+        splitTree(nodeRight, goesLeft, middle, right);
+        left = joinTrees(nodeLeft, node, middle);
+    }
+    else {
+        Subtree middle;
+        splitTree(nodeLeft, goesLeft, left, middle);
+        right = joinTrees(middle, node, nodeRight);
+    }
+}
 
-    std::string connector(countSpace, '-');
-    std::string emptySpace(countSpace, ' ');
+// Сколько верхних уровней рекурсии делятся между потоками: задач в несколько раз больше потоков
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+int RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::forkDepth(size_t nodes, ThreadPool& pool)
+{
+    if (nodes < minParallelNodes || pool.concurrency() < 2) return 0;
 
-    std::vector<T> transferPoints = countNodesAtEachLevel(root);
-    int transferIndex = 0;
-    int currentIndex = 0;
+    int depth = 2;
+    while ((size_t(1) << depth) < pool.concurrency()) {
+        depth++;
+    }
+    return depth + 2;
+}
 
-    std::queue<TreeNode*> unprinted;
-    std::queue<int> places{};
-    places.push(1);
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+template <typename Left, typename Right>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::fork(ThreadPool& pool, int depth, Left left, Right right)
+{
+    if (depth <= 0) {
+        left();
+        right();
+        return;
+    }
 
-    int lastPos = 0;
-    unprinted.push(root);
-    while (!unprinted.empty())
-    {
-        TreeNode* current = unprinted.front();
-        currentIndex++;
-        unprinted.pop();
+    pool.parallelFor(2, [&left, &right](size_t branch) {
+        if (branch == 0) left();
+        else right();
+    });
+}
 
-        std::string emptySpace(countSpace * (4 * (places.front() - lastPos) - 2) - (lastPos == 0 ? countSpace : 0), ' '); // 2 6 11 14-15 18-19
-        std::string microSpace(countSpace, ' ');
-        std::string connector(countSpace, '-');
+// Корень a делит b на две части, половины объединяются независимо и соединяются через него
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::Subtree RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::unionTrees(Subtree a, Subtree b, ThreadPool& pool, int depth)
+{
+    if (!a.root) return b;
+    if (!b.root) return a;
+
+    TreeNode* key = a.root;
+    Subtree aLeft = detachChild(a, true);
+    Subtree aRight = detachChild(a, false);
+    Subtree bLeft, bRight;
+    splitTree(b, [key](const T& value) { return value < key->value; }, bLeft, bRight);
+
+    Subtree left, right;
+    fork(pool, depth,
+        [&] { left = unionTrees(aLeft, bLeft, pool, depth - 1); },
+        [&] { right = unionTrees(aRight, bRight, pool, depth - 1); });
+    return joinTrees(left, key, right);
+}
 
-        std::cout << emptySpace;
-        if (current->left != nullptr) {
-            std::cout << connector;
-            unprinted.push(current->left);
-            places.push(places.front() * 2 - 1);
-        }
-        else {
-            std::cout << microSpace;
-        }
-        std::cout << current->value;
-        if (current->right != nullptr) {
-            std::cout << connector;
-            unprinted.push(current->right);
-            places.push(places.front() * 2);
+// Другое дерево b только читается: его корень делит a на меньшие, равные и большие значения.
+// Выброшенные поддеревья копятся в discarded и освобождаются после, в одном потоке
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::Subtree RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::intersectTrees(Subtree a, const TreeNode* b, std::vector<TreeNode*>& discarded, ThreadPool& pool, int depth)
+{
+    if (!a.root) return a;
+    if (!b) {
+        discarded.push_back(a.root);
+        return { nullptr, 0 };
+    }
+
+    const T& key = b->value;
+    Subtree less, rest, equal, greater;
+    splitTree(a, [&key](const T& value) { return value < key; }, less, rest);
+    splitTree(rest, [&key](const T& value) { return !(key < value); }, equal, greater);
+
+    Subtree left, right;
+    std::vector<TreeNode*> rightDiscarded;
+    fork(pool, depth,
+        [&] { left = intersectTrees(less, b->left, discarded, pool, depth - 1); },
+        [&] { right = intersectTrees(greater, b->right, depth > 0 ? rightDiscarded : discarded, pool, depth - 1); });
+    discarded.insert(discarded.end(), rightDiscarded.begin(), rightDiscarded.end());
+
+    return joinTrees(joinTrees(left, equal), right);
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+typename RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::Subtree RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::differenceTrees(Subtree a, const TreeNode* b, std::vector<TreeNode*>& discarded, ThreadPool& pool, int depth)
+{
+    if (!a.root || !b) return a;
+
+    const T& key = b->value;
+    Subtree less, rest, equal, greater;
+    splitTree(a, [&key](const T& value) { return value < key; }, less, rest);
+    splitTree(rest, [&key](const T& value) { return !(key < value); }, equal, greater);
+    if (equal.root) discarded.push_back(equal.root);
+
+    Subtree left, right;
+    std::vector<TreeNode*> rightDiscarded;
+    fork(pool, depth,
+        [&] { left = differenceTrees(less, b->left, discarded, pool, depth - 1); },
+        [&] { right = differenceTrees(greater, b->right, depth > 0 ? rightDiscarded : discarded, pool, depth - 1); });
+    discarded.insert(discarded.end(), rightDiscarded.begin(), rightDiscarded.end());
+
+    return joinTrees(left, right);
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::join(RedBlackTree& right)
+{
+    static_assert(Duplicates == DuplicatePolicy::Multiset, "RedBlackTree: set operations require DuplicatePolicy::Multiset");
+
+    if (&right == this || !right.root) return;
+    // Значения перекрываются: обычное объединение даёт тот же результат
+    if (root && *right.begin() < *--end()) {
+        unionWith(right);
+        return;
+    }
+
+    size_t count = nodeCount + right.nodeCount;
+    Subtree result = joinTrees(detachRoot(), right.detachRoot());
+    allocator.splice(right.allocator);
+    attachRoot(result, count);
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::split(const T& key, RedBlackTree& right)
+{
+    static_assert(Duplicates == DuplicatePolicy::Multiset, "RedBlackTree: set operations require DuplicatePolicy::Multiset");
+
+    if (&right == this) return;
+    right.clear();
+
+    size_t count = nodeCount;
+    Subtree less, notLess;
+    splitTree(detachRoot(), [&key](const T& value) { return value < key; }, less, notLess);
+
+    std::vector<T> moved;
+    for (const TreeNode* node = notLess.root ? leftmost(notLess.root) : nullptr; node; node = successor(node)) {
+        moved.push_back(node->value);
+    }
+    count -= destroySubtree(notLess.root, allocator);
+
+    attachRoot(less, count);
+    right.bulkLoad(moved);
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::unionWith(RedBlackTree& other, ThreadPool& pool)
+{
+    static_assert(Duplicates == DuplicatePolicy::Multiset, "RedBlackTree: set operations require DuplicatePolicy::Multiset");
+
+    if (&other == this || !other.root) return;
+
+    size_t count = nodeCount + other.nodeCount;
+    int depth = forkDepth(count, pool);
+    Subtree result = unionTrees(detachRoot(), other.detachRoot(), pool, depth);
+    allocator.splice(other.allocator);
+    attachRoot(result, count);
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::intersect(const RedBlackTree& other, ThreadPool& pool)
+{
+    static_assert(Duplicates == DuplicatePolicy::Multiset, "RedBlackTree: set operations require DuplicatePolicy::Multiset");
+
+    if (&other == this) return;
+
+    size_t count = nodeCount;
+    int depth = forkDepth(nodeCount + other.nodeCount, pool);
+    std::vector<TreeNode*> discarded;
+    Subtree result = intersectTrees(detachRoot(), other.root, discarded, pool, depth);
+    for (TreeNode* node : discarded) {
+        count -= destroySubtree(node, allocator);
+    }
+    attachRoot(result, count);
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::difference(const RedBlackTree& other, ThreadPool& pool)
+{
+    static_assert(Duplicates == DuplicatePolicy::Multiset, "RedBlackTree: set operations require DuplicatePolicy::Multiset");
+
+    if (&other == this) {
+        clear();
+        return;
+    }
+
+    size_t count = nodeCount;
+    int depth = forkDepth(nodeCount + other.nodeCount, pool);
+    std::vector<TreeNode*> discarded;
+    Subtree result = differenceTrees(detachRoot(), other.root, discarded, pool, depth);
+    for (TreeNode* node : discarded) {
+        count -= destroySubtree(node, allocator);
+    }
+    attachRoot(result, count);
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+int RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::getHeight() const
+{
+    return getHeight(root);
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+int RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::getHeight(const TreeNode* root) const {
+    int height = 0;
+
+    reverseInOrder(root, 0, false, [&height](const TreeNode*, int level, bool) {
+        height = std::max(height, level + 1);
+    });
+
+    TREE_STAT_HISTOGRAM(heights, static_cast<size_t>(height));
+    return height;
+}
+
+// Обратный симметричный обход (правое поддерево, узел, левое) по указателям на родителя:
+// без рекурсии и без стека. visit(node, level, isRight) получает глубину узла
+// относительно start и то, правый ли он ребёнок
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+template <typename Visit>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::reverseInOrder(const TreeNode* start, int level, bool isRight, Visit visit) const
+{
+    if (!start) return;
+
+    const TreeNode* current = start;
+    while (current->right) {
+        current = current->right;
+        level++;
+    }
+
+    while (true) {
+        visit(current, level, current == start ? isRight : current == current->parent->right);
+
+        if (current->left) {
+            current = current->left;
+            level++;
+            while (current->right) {
+                current = current->right;
+                level++;
+            }
         }
         else {
-            std::cout << microSpace;
-        }
-
-        lastPos = places.front();
-        places.pop();
+            while (current != start && current == current->parent->left) {
+                current = current->parent;
+                level--;
+            }
+            if (current == start) break;
 
-        if (transferIndex < transferPoints.size() && currentIndex >= transferPoints[transferIndex]) {
-            transferIndex++;
-            currentIndex = 0;
-            lastPos = 0;
-            countSpace = max(countSpace / 2, 1);
-            std::cout << '\n';
+            current = current->parent;
+            level--;
         }
     }
 }
 
-template <typename T>
-void RedBlackTree<T>::printSecond(TreeNode* root, int level, bool isRight) const
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+bool RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::render(OutputBuffer& out, const RenderOptions& options) const
+{
+    return renderFrom(root, out, options);
+}
+
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+bool RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::render(OutputBuffer& out, const RenderOptions& options, const T& from) const
 {
-    if (root == NULL) return;
-    printSecond(root->right, level + 1, true);
+    const TreeNode* node = search(from);
+    return node && renderFrom(node, out, options);
+}
 
-    if (!level) std::cout << "-->";
-    else std::cout << "   ";
+// Без ограничения глубины боковой вид идёт обходом самого дерева, которому не нужен стек
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+bool RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::renderFrom(const TreeNode* node, OutputBuffer& out, const RenderOptions& options) const
+{
+    typedef TreeRenderer<TreeNode> Renderer;
 
-    for (int i = 0; i < level; i++) {
-        if (i + 1 == level) isRight ? std::cout << ".-->" : std::cout << "`-->";
-        else std::cout << "    ";
-    }
+    const TreeNode* start = Renderer::descend(node, options.path);
+    if (!start) return !node && options.path.empty();
 
-    std::cout << root->value << "\n";
+    Renderer renderer(out, options);
+    if (options.layout == TreeLayout::TopDown) {
+        renderer.topDown(start);
+    }
+    else if (options.maxDepth >= 0) {
+        renderer.sideways(start);
+    }
+    else {
+        reverseInOrder(start, 0, false, [&renderer](const TreeNode* node, int level, bool isRight) {
+            renderer.line(node, level, isRight);
+        });
+    }
+    return true;
+}
 
-    printSecond(root->left, level + 1);
+// Всё, что было выведено через std::cout, уходит раньше дерева
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::print() const
+{
+    std::cout.flush();
+    OutputBuffer out;
+    RenderOptions options;
+    options.layout = TreeLayout::TopDown;
+    // Полный вывод, как прежде: уровни не сокращаются
+    options.maxLevelWidth = SIZE_MAX;
+    render(out, options);
 }
 
-template <typename T>
-void RedBlackTree<T>::printSecond() 
+template <typename T, template <typename> class NodeAllocator, bool OrderStatistics, DuplicatePolicy Duplicates>
+void RedBlackTree<T, NodeAllocator, OrderStatistics, Duplicates>::printSecond()
 {
-    printSecond(root, 0, false);
+    std::cout.flush();
+    OutputBuffer out;
+    render(out);
 }
 
 #endif // BINARYTREE_H
@@ -0,0 +1,156 @@
+﻿#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Пул рабочих потоков с очередью задач.
+// parallelFor раздаёт индексы через общий счётчик, и вызывающий поток тоже их берёт:
+// вложенный parallelFor из задачи пула не может зависнуть, даже если все потоки заняты
+class ThreadPool {
+public:
+    explicit ThreadPool(size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Общий пул процесса: по потоку на ядро, кроме вызывающего
+    static ThreadPool& shared();
+
+    size_t size() const;
+    // Сколько потоков участвует в parallelFor вместе с вызывающим
+    size_t concurrency() const;
+    void submit(std::function<void()> task);
+
+    // body(index) для каждого index из [0, count); возвращается, когда выполнены все
+    template <typename Body>
+    void parallelFor(size_t count, Body body);
+
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()>> tasks;
+    std::mutex queueMutex;
+    std::condition_variable queueChanged;
+    bool stopping;
+
+    void workerLoop();
+};
+
+inline ThreadPool::ThreadPool(size_t threads) : stopping(false)
+{
+    for (size_t i = 0; i < threads; i++) {
+        workers.emplace_back([this] { workerLoop(); });
+    }
+}
+
+inline ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueChanged.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+inline ThreadPool& ThreadPool::shared()
+{
+    static ThreadPool pool(std::max<size_t>(std::thread::hardware_concurrency(), 1) - 1);
+    return pool;
+}
+
+inline size_t ThreadPool::size() const
+{
+    return workers.size();
+}
+
+inline size_t ThreadPool::concurrency() const
+{
+    return workers.size() + 1;
+}
+
+inline void ThreadPool::submit(std::function<void()> task)
+{
+    {
+        std::lock_guard<std::mutex> lock(queueMutex);
+        tasks.push_back(std::move(task));
+    }
+    queueChanged.notify_one();
+}
+
+inline void ThreadPool::workerLoop()
+{
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(queueMutex);
+            queueChanged.wait(lock, [this] { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return;
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+template <typename Body>
+void ThreadPool::parallelFor(size_t count, Body body)
+{
+    if (count == 0) return;
+    if (count == 1 || workers.empty()) {
+        for (size_t index = 0; index < count; index++) {
+            body(index);
+        }
+        return;
+    }
+
+    // Состояние живёт, пока его держит хоть одна задача: поздно стартовавший помощник
+    // может застать цикл уже завершённым
+    struct Loop {
+        std::atomic<size_t> next;
+        std::atomic<size_t> done;
+        std::mutex doneMutex;
+        std::condition_variable finished;
+        Body body;
+        size_t count;
+
+        Loop(const Body& body, size_t count) : next(0), done(0), body(body), count(count) {}
+
+        void work()
+        {
+            size_t completed = 0;
+            for (size_t index = next.fetch_add(1); index < count; index = next.fetch_add(1)) {
+                body(index);
+                completed++;
+            }
+            if (completed && done.fetch_add(completed) + completed == count) {
+                std::lock_guard<std::mutex> lock(doneMutex);
+                finished.notify_all();
+            }
+        }
+    };
+
+    std::shared_ptr<Loop> loop = std::make_shared<Loop>(body, count);
+    size_t helpers = std::min(workers.size(), count - 1);
+    for (size_t i = 0; i < helpers; i++) {
+        submit([loop] { loop->work(); });
+    }
+
+    loop->work();
+
+    std::unique_lock<std::mutex> lock(loop->doneMutex);
+    loop->finished.wait(lock, [&loop] { return loop->done.load() == loop->count; });
+}
+
+#endif // THREADPOOL_H
@@ -0,0 +1,370 @@
+﻿#ifndef TREEFORMAT_H
+#define TREEFORMAT_H
+
+#include "MappedFile.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <ostream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+// Двоичный формат сохранённого дерева. Числа записываются в порядке байтов
+// машины (little-endian на x86/x64), значения — побайтовой копией T.
+//   заголовок, 32 байта: магия "AISDTREE", версия (uint16), вид дерева (uint8),
+//     тип значения (uint8), размер значения (uint8), 3 резервных байта,
+//     число узлов (uint64), 8 резервных байт;
+//   структура: по 2 бита на узел в прямом порядке — есть ли левый и правый ребёнок;
+//   цвета (только КЧ-дерево): по биту на узел в прямом порядке, 1 — чёрный;
+//   значения: по sizeof(T) байт на узел в прямом порядке.
+// Каждая секция начинается с границы 8 байт: в отображённом файле значения
+// выровнены, и их можно читать на месте. У снимка FrozenTree секций структуры
+// и цветов нет, а значения идут массивом Эйтцингера вместе с пустой ячейкой 0
+enum class TreeKind : uint8_t {
+    Binary = 1,
+    RedBlack = 2,
+    Frozen = 3
+};
+
+enum class FormatError {
+    None,
+    ReadFailure,
+    WriteFailure,
+    BadMagic,
+    UnsupportedVersion,
+    WrongKind,
+    WrongValueType,
+    Truncated,
+    CorruptStructure,
+    Unordered,
+    Misaligned
+};
+
+// Запись секций в поток (через промежуточный буфер) или прямо в вектор
+class TreeFileSink {
+public:
+    explicit TreeFileSink(std::ostream& out);
+    explicit TreeFileSink(std::vector<char>& buffer);
+    ~TreeFileSink();
+
+    TreeFileSink(const TreeFileSink&) = delete;
+    TreeFileSink& operator=(const TreeFileSink&) = delete;
+
+    void write(const void* bytes, size_t length);
+    void put(unsigned char byte);
+    // Дополняет нулями до границы 8 байт
+    void pad();
+    bool flush();
+
+private:
+    static const size_t stagingSize = 1 << 16;
+
+    std::ostream* out;
+    std::vector<char>* buffer;
+    std::vector<char> staging;
+    uint64_t written;
+};
+
+inline TreeFileSink::TreeFileSink(std::ostream& out) : out(&out), buffer(nullptr), written(0)
+{
+    staging.reserve(stagingSize);
+}
+
+inline TreeFileSink::TreeFileSink(std::vector<char>& buffer) : out(nullptr), buffer(&buffer), written(0) {}
+
+inline TreeFileSink::~TreeFileSink()
+{
+    flush();
+}
+
+inline void TreeFileSink::write(const void* bytes, size_t length)
+{
+    const char* first = static_cast<const char*>(bytes);
+    written += length;
+    if (buffer) {
+        buffer->insert(buffer->end(), first, first + length);
+        return;
+    }
+
+    if (staging.size() + length > stagingSize) {
+        flush();
+    }
+    if (length > stagingSize) {
+        out->write(first, static_cast<std::streamsize>(length));
+    }
+    else {
+        staging.insert(staging.end(), first, first + length);
+    }
+}
+
+inline void TreeFileSink::put(unsigned char byte)
+{
+    written++;
+    if (buffer) {
+        buffer->push_back(static_cast<char>(byte));
+        return;
+    }
+
+    if (staging.size() == stagingSize) {
+        flush();
+    }
+    staging.push_back(static_cast<char>(byte));
+}
+
+inline void TreeFileSink::pad()
+{
+    static const char zeros[8] = {};
+    if (written % 8) {
+        write(zeros, 8 - written % 8);
+    }
+}
+
+inline bool TreeFileSink::flush()
+{
+    if (!out) return true;
+    if (!staging.empty()) {
+        out->write(staging.data(), static_cast<std::streamsize>(staging.size()));
+        staging.clear();
+    }
+    return static_cast<bool>(*out);
+}
+
+template <typename T>
+class TreeFormat {
+    static_assert(std::is_trivially_copyable<T>::value, "values are stored as raw bytes");
+
+public:
+    static const uint16_t version = 1;
+    static const size_t headerSize = 32;
+
+    // Смещения секций в байтах от начала файла
+    struct Layout {
+        uint64_t count;
+        size_t structure;
+        size_t colours;
+        size_t values;
+        size_t total;
+    };
+
+    static Layout layout(TreeKind kind, uint64_t count);
+    // Проверяет заголовок и размер; при успехе layout описывает секции data
+    static FormatError open(const char* data, size_t size, TreeKind kind, Layout& layout);
+
+    static bool bit(const char* bits, uint64_t index);
+    static T value(const char* values, uint64_t index);
+
+    // walk(emit) должен вызвать emit(hasLeft, hasRight, isBlack, value) для каждого узла
+    // в прямом порядке (для снимка — для каждой ячейки массива, начиная с нулевой).
+    // Секции пишутся по очереди, поэтому дерево обходится до трёх раз, зато без копии
+    template <typename Walk>
+    static void write(TreeFileSink& sink, TreeKind kind, uint64_t count, Walk walk);
+    template <typename Walk>
+    static FormatError save(std::ostream& out, TreeKind kind, uint64_t count, Walk walk);
+    template <typename Walk>
+    static void save(std::vector<char>& buffer, TreeKind kind, uint64_t count, Walk walk);
+    template <typename Walk>
+    static FormatError saveFile(const std::string& path, TreeKind kind, uint64_t count, Walk walk);
+
+    static FormatError readAll(std::istream& input, std::vector<char>& buffer);
+    // Отображает файл в память (или читает его, если отобразить нельзя) и передаёт в load(data, size)
+    template <typename Load>
+    static FormatError loadFile(const std::string& path, Load load);
+
+private:
+    static const char magic[8];
+
+    static uint8_t valueType();
+    static size_t align(size_t offset);
+};
+
+template <typename T>
+const char TreeFormat<T>::magic[8] = { 'A', 'I', 'S', 'D', 'T', 'R', 'E', 'E' };
+
+// 1 — знаковое целое, 2 — беззнаковое, 3 — с плавающей точкой, 0 — прочие типы
+template <typename T>
+uint8_t TreeFormat<T>::valueType()
+{
+    if (std::is_floating_point<T>::value) return 3;
+    if (std::is_integral<T>::value) return std::is_signed<T>::value ? 1 : 2;
+    return 0;
+}
+
+template <typename T>
+size_t TreeFormat<T>::align(size_t offset)
+{
+    return (offset + 7) & ~size_t(7);
+}
+
+template <typename T>
+typename TreeFormat<T>::Layout TreeFormat<T>::layout(TreeKind kind, uint64_t count)
+{
+    Layout result;
+    result.count = count;
+    result.structure = headerSize;
+    result.colours = result.structure;
+    if (kind != TreeKind::Frozen) {
+        result.colours = align(result.structure + static_cast<size_t>((2 * count + 7) / 8));
+    }
+    result.values = result.colours;
+    if (kind == TreeKind::RedBlack) {
+        result.values = align(result.colours + static_cast<size_t>((count + 7) / 8));
+    }
+    uint64_t valueCount = kind == TreeKind::Frozen ? count + 1 : count;
+    result.total = align(result.values + static_cast<size_t>(valueCount) * sizeof(T));
+    return result;
+}
+
+template <typename T>
+FormatError TreeFormat<T>::open(const char* data, size_t size, TreeKind kind, Layout& result)
+{
+    if (size < headerSize) return FormatError::Truncated;
+    if (std::memcmp(data, magic, sizeof(magic)) != 0) return FormatError::BadMagic;
+
+    uint16_t fileVersion;
+    uint64_t count;
+    std::memcpy(&fileVersion, data + 8, sizeof(fileVersion));
+    std::memcpy(&count, data + 16, sizeof(count));
+
+    if (fileVersion != version) return FormatError::UnsupportedVersion;
+    if (static_cast<uint8_t>(data[10]) != static_cast<uint8_t>(kind)) return FormatError::WrongKind;
+    if (static_cast<uint8_t>(data[11]) != valueType() || static_cast<uint8_t>(data[12]) != sizeof(T)) {
+        return FormatError::WrongValueType;
+    }
+    // Каждый узел занимает в файле хотя бы sizeof(T) байт: так размеры секций не переполнятся
+    if (count >= size / sizeof(T)) return FormatError::Truncated;
+
+    result = layout(kind, count);
+    if (result.total > size) return FormatError::Truncated;
+    return FormatError::None;
+}
+
+template <typename T>
+bool TreeFormat<T>::bit(const char* bits, uint64_t index)
+{
+    return (static_cast<unsigned char>(bits[index / 8]) >> (index % 8)) & 1;
+}
+
+template <typename T>
+T TreeFormat<T>::value(const char* values, uint64_t index)
+{
+    T result;
+    std::memcpy(&result, values + index * sizeof(T), sizeof(T));
+    return result;
+}
+
+template <typename T>
+template <typename Walk>
+void TreeFormat<T>::write(TreeFileSink& sink, TreeKind kind, uint64_t count, Walk walk)
+{
+    char header[headerSize] = {};
+    std::memcpy(header, magic, sizeof(magic));
+    uint16_t fileVersion = version;
+    std::memcpy(header + 8, &fileVersion, sizeof(fileVersion));
+    header[10] = static_cast<char>(kind);
+    header[11] = static_cast<char>(valueType());
+    header[12] = static_cast<char>(sizeof(T));
+    std::memcpy(header + 16, &count, sizeof(count));
+    sink.write(header, headerSize);
+
+    unsigned char byte = 0;
+    int shift = 0;
+    if (kind != TreeKind::Frozen) {
+        walk([&](bool hasLeft, bool hasRight, bool, const T&) {
+            byte |= static_cast<unsigned char>((hasLeft ? 1 : 0) | (hasRight ? 2 : 0)) << shift;
+            shift += 2;
+            if (shift == 8) {
+                sink.put(byte);
+                byte = 0;
+                shift = 0;
+            }
+        });
+        if (shift) sink.put(byte);
+        sink.pad();
+    }
+
+    if (kind == TreeKind::RedBlack) {
+        byte = 0;
+        shift = 0;
+        walk([&](bool, bool, bool isBlack, const T&) {
+            byte |= static_cast<unsigned char>(isBlack ? 1 : 0) << shift;
+            if (++shift == 8) {
+                sink.put(byte);
+                byte = 0;
+                shift = 0;
+            }
+        });
+        if (shift) sink.put(byte);
+        sink.pad();
+    }
+
+    walk([&](bool, bool, bool, const T& value) {
+        sink.write(&value, sizeof(T));
+    });
+    sink.pad();
+}
+
+template <typename T>
+template <typename Walk>
+FormatError TreeFormat<T>::save(std::ostream& out, TreeKind kind, uint64_t count, Walk walk)
+{
+    TreeFileSink sink(out);
+    write(sink, kind, count, walk);
+    return sink.flush() ? FormatError::None : FormatError::WriteFailure;
+}
+
+template <typename T>
+template <typename Walk>
+void TreeFormat<T>::save(std::vector<char>& buffer, TreeKind kind, uint64_t count, Walk walk)
+{
+    buffer.clear();
+    buffer.reserve(layout(kind, count).total);
+    TreeFileSink sink(buffer);
+    write(sink, kind, count, walk);
+}
+
+template <typename T>
+template <typename Walk>
+FormatError TreeFormat<T>::saveFile(const std::string& path, TreeKind kind, uint64_t count, Walk walk)
+{
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    if (!out) return FormatError::WriteFailure;
+
+    FormatError error = save(out, kind, count, walk);
+    out.close();
+    if (error == FormatError::None && !out) return FormatError::WriteFailure;
+    return error;
+}
+
+template <typename T>
+FormatError TreeFormat<T>::readAll(std::istream& input, std::vector<char>& buffer)
+{
+    buffer.clear();
+    char chunk[1 << 16];
+    while (input.read(chunk, sizeof(chunk)) || input.gcount() > 0) {
+        buffer.insert(buffer.end(), chunk, chunk + input.gcount());
+    }
+    return input.bad() ? FormatError::ReadFailure : FormatError::None;
+}
+
+template <typename T>
+template <typename Load>
+FormatError TreeFormat<T>::loadFile(const std::string& path, Load load)
+{
+    MappedFile mapped(path);
+    if (mapped.isOpen()) {
+        return load(mapped.data(), mapped.size());
+    }
+
+    std::ifstream input(path, std::ios::binary);
+    if (!input) return FormatError::ReadFailure;
+
+    std::vector<char> buffer;
+    FormatError error = readAll(input, buffer);
+    if (error != FormatError::None) return error;
+    return load(buffer.data(), buffer.size());
+}
+
+#endif // TREEFORMAT_H
@@ -0,0 +1,271 @@
+﻿#ifndef TREERENDERER_H
+#define TREERENDERER_H
+
+#include "OutputBuffer.h"
+#include <charconv>
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+enum class TreeLayout {
+    Sideways, // строка на узел: корень слева, правое поддерево выше левого
+    TopDown   // строка на уровень: корень сверху, дети соединены с родителем чёрточками
+};
+
+struct RenderOptions {
+    TreeLayout layout = TreeLayout::Sideways;
+    // Узлы глубже не выводятся (корень выводимого поддерева — глубина 0); -1 — без ограничения
+    int maxDepth = -1;
+    // Только для TopDown: если на уровне больше узлов, середина уровня заменяется
+    // отметкой "...(k)", а поддеревья пропущенных узлов не выводятся вовсе
+    size_t maxLevelWidth = 16;
+    // Путь от корня к корню выводимого поддерева: L — влево, R — вправо
+    std::string path;
+};
+
+// Вывод дерева за время, линейное по размеру вывода: узлы глубже maxDepth и
+// поддеревья пропущенных узлов не посещаются, отступы пишутся кусками из готового
+// блока, а ширина строки TopDown растёт с числом выведенных узлов, а не с высотой дерева.
+// Node — узел с полями left, right и value
+template <typename Node>
+class TreeRenderer {
+public:
+    TreeRenderer(OutputBuffer& out, const RenderOptions& options);
+
+    // Корень поддерева по пути; nullptr, если в дереве нет такого пути
+    static const Node* descend(const Node* root, const std::string& path);
+
+    // Строка Sideways для узла из обратного симметричного обхода, который дерево делает само
+    void line(const Node* node, int level, bool isRight);
+    // Sideways с ограничением глубины: стек обхода не глубже maxDepth
+    void sideways(const Node* start);
+    void topDown(const Node* start);
+
+private:
+    static const size_t none = static_cast<size_t>(-1);
+
+    // Узел или отметка пропущенных узлов уровня (node == nullptr)
+    struct Item {
+        const Node* node;
+        size_t left;
+        size_t right;
+        // Отметка, которая стоит в симметричном порядке сразу за поддеревом этого узла
+        size_t after;
+        size_t column;
+        size_t label;
+        size_t width;
+    };
+
+    OutputBuffer& out;
+    const RenderOptions& options;
+
+    void pad(char symbol, size_t count);
+    template <typename Value>
+    void value(const Value& value);
+    template <typename Value>
+    static void appendLabel(std::string& labels, const Value& value);
+};
+
+template <typename Node>
+TreeRenderer<Node>::TreeRenderer(OutputBuffer& out, const RenderOptions& options) : out(out), options(options) {}
+
+template <typename Node>
+const Node* TreeRenderer<Node>::descend(const Node* root, const std::string& path)
+{
+    const Node* node = root;
+    for (size_t i = 0; i < path.size() && node; i++) {
+        char step = path[i];
+        if (step == 'L' || step == 'l') node = node->left;
+        else if (step == 'R' || step == 'r') node = node->right;
+        else return nullptr;
+    }
+    return node;
+}
+
+template <typename Node>
+void TreeRenderer<Node>::pad(char symbol, size_t count)
+{
+    static const std::string spaces(64, ' ');
+    static const std::string dashes(64, '-');
+    const std::string& block = symbol == '-' ? dashes : spaces;
+    while (count) {
+        size_t length = count < block.size() ? count : block.size();
+        out.text(block.data(), length);
+        count -= length;
+    }
+}
+
+template <typename Node>
+template <typename Value>
+void TreeRenderer<Node>::value(const Value& value)
+{
+    static_assert(std::is_arithmetic<Value>::value, "TreeRenderer prints numbers only");
+    char text[64];
+    std::to_chars_result result = std::to_chars(text, text + sizeof(text), value);
+    out.text(text, static_cast<size_t>(result.ptr - text));
+}
+
+template <typename Node>
+template <typename Value>
+void TreeRenderer<Node>::appendLabel(std::string& labels, const Value& value)
+{
+    static_assert(std::is_arithmetic<Value>::value, "TreeRenderer prints numbers only");
+    char text[64];
+    std::to_chars_result result = std::to_chars(text, text + sizeof(text), value);
+    labels.append(text, static_cast<size_t>(result.ptr - text));
+}
+
+// Тот же вид, что у прежнего printSecond; у узла на границе глубины, под которым
+// есть ещё узлы, в конце строки стоит " ..."
+template <typename Node>
+void TreeRenderer<Node>::line(const Node* node, int level, bool isRight)
+{
+    if (!level) {
+        out.text("-->", 3);
+    }
+    else {
+        pad(' ', 3 + 4 * static_cast<size_t>(level - 1));
+        out.text(isRight ? ".-->" : "`-->", 4);
+    }
+    value(node->value);
+    if (level == options.maxDepth && (node->left || node->right)) {
+        out.text(" ...", 4);
+    }
+    out.text("\n", 1);
+}
+
+template <typename Node>
+void TreeRenderer<Node>::sideways(const Node* start)
+{
+    struct Frame {
+        const Node* node;
+        int level;
+        bool isRight;
+        bool expanded;
+    };
+
+    if (!start) return;
+
+    std::vector<Frame> stack;
+    stack.push_back({ start, 0, false, false });
+    while (!stack.empty()) {
+        Frame frame = stack.back();
+        stack.pop_back();
+
+        if (frame.expanded || frame.level == options.maxDepth) {
+            line(frame.node, frame.level, frame.isRight);
+            continue;
+        }
+        // Снимается со стека в порядке: правое поддерево, узел, левое
+        if (frame.node->left) stack.push_back({ frame.node->left, frame.level + 1, false, false });
+        stack.push_back({ frame.node, frame.level, frame.isRight, true });
+        if (frame.node->right) stack.push_back({ frame.node->right, frame.level + 1, true, false });
+    }
+}
+
+// Уровни собираются в ширину, по не более maxLevelWidth узлов (и одной отметке) на уровень.
+// Колонка каждого узла — его место в симметричном порядке среди выведенных, поэтому
+// поддеревья не перекрываются, а отметка встаёт сразу за поддеревом последнего узла
+// левой половины уровня
+template <typename Node>
+void TreeRenderer<Node>::topDown(const Node* start)
+{
+    if (!start) return;
+
+    size_t width = options.maxLevelWidth < 2 ? 2 : options.maxLevelWidth;
+    std::vector<Item> items;
+    std::vector<size_t> levels;
+    std::string labels;
+
+    struct Child {
+        const Node* node;
+        size_t parent;
+        bool isRight;
+    };
+
+    std::vector<Child> next;
+    items.push_back({ start, none, none, none, 0, 0, 0 });
+    levels.push_back(0);
+
+    for (int level = 0; level != options.maxDepth; level++) {
+        next.clear();
+        for (size_t i = levels.back(); i < items.size(); i++) {
+            if (!items[i].node) continue;
+            if (items[i].node->left) next.push_back({ items[i].node->left, i, false });
+            if (items[i].node->right) next.push_back({ items[i].node->right, i, true });
+        }
+        if (next.empty()) break;
+
+        size_t kept = next.size() > width ? width : next.size();
+        levels.push_back(items.size());
+        for (size_t i = 0; i < next.size(); i++) {
+            if (kept < next.size() && i == kept / 2) {
+                size_t hidden = next.size() - kept;
+                items[items.size() - 1].after = items.size();
+                items.push_back({ nullptr, none, none, none, 0, labels.size(), 0 });
+                labels += "...(";
+                appendLabel(labels, hidden);
+                labels += ")";
+                items.back().width = labels.size() - items.back().label;
+                i += hidden - 1;
+                continue;
+            }
+            Item& parent = items[next[i].parent];
+            (next[i].isRight ? parent.right : parent.left) = items.size();
+            items.push_back({ next[i].node, none, none, none, 0, 0, 0 });
+        }
+    }
+
+    for (Item& item : items) {
+        if (!item.node) continue;
+        item.label = labels.size();
+        appendLabel(labels, item.node->value);
+        item.width = labels.size() - item.label;
+    }
+
+    // Симметричный обход по выведенным узлам; стек не глубже удвоенного числа уровней
+    size_t column = 0;
+    std::vector<std::pair<size_t, bool>> stack;
+    stack.push_back({ 0, false });
+    while (!stack.empty()) {
+        std::pair<size_t, bool> frame = stack.back();
+        stack.pop_back();
+        Item& item = items[frame.first];
+
+        if (frame.second || !item.node) {
+            item.column = column;
+            column += item.width + 1;
+            continue;
+        }
+        if (item.after != none) stack.push_back({ item.after, false });
+        if (item.right != none) stack.push_back({ item.right, false });
+        stack.push_back({ frame.first, true });
+        if (item.left != none) stack.push_back({ item.left, false });
+    }
+
+    levels.push_back(items.size());
+    for (size_t level = 0; level + 1 < levels.size(); level++) {
+        size_t cursor = 0;
+        for (size_t i = levels[level]; i < levels[level + 1]; i++) {
+            const Item& item = items[i];
+            size_t first = item.column;
+            if (item.left != none) {
+                first = items[item.left].column + items[item.left].width / 2;
+            }
+            pad(' ', first - cursor);
+            pad('-', item.column - first);
+            out.text(labels.data() + item.label, item.width);
+            cursor = item.column + item.width;
+            if (item.right != none) {
+                size_t last = items[item.right].column + items[item.right].width / 2 + 1;
+                pad('-', last - cursor);
+                cursor = last;
+            }
+        }
+        out.text("\n", 1);
+    }
+}
+
+#endif // TREERENDERER_H
@@ -0,0 +1,202 @@
+﻿#ifndef TREESTATS_H
+#define TREESTATS_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// Счётчики горячих путей RedBlackTree. Считаются, только если программа собрана
+// с RBTREE_STATS; без него макросы TREE_STAT* не порождают кода.
+// Каждый поток пишет в свой блок, поэтому счётчики не делят строк кэша между потоками
+// и не требуют атомарных сложений: поток-владелец просто перезаписывает значение,
+// а snapshot() складывает блоки всех потоков
+#if defined(RBTREE_STATS)
+#define TREE_STAT(counter) TreeStats::local().add(&TreeStats::Block::counter, 1)
+#define TREE_STAT_ADD(counter, amount) TreeStats::local().add(&TreeStats::Block::counter, amount)
+#define TREE_STAT_HISTOGRAM(histogram, value) TreeStats::local().record(&TreeStats::Block::histogram, value)
+#define TREE_STAT_ONLY(statement) statement
+#else
+#define TREE_STAT(counter) ((void)0)
+#define TREE_STAT_ADD(counter, amount) ((void)0)
+#define TREE_STAT_HISTOGRAM(histogram, value) ((void)0)
+#define TREE_STAT_ONLY(statement)
+#endif
+
+struct TreeStatsSnapshot {
+    // Последняя ячейка гистограммы собирает все значения не меньше её номера
+    static const size_t histogramSize = 64;
+
+    uint64_t rotations = 0;
+    // Проходы циклов восстановления свойств после вставки и удаления
+    uint64_t insertFixups = 0;
+    uint64_t deleteFixups = 0;
+    uint64_t recolorings = 0;
+    // searchDepth[k] — сколько поисков просмотрели k узлов
+    uint64_t searchDepth[histogramSize] = {};
+    // heights[k] — сколько раз getHeight вернул k
+    uint64_t heights[histogramSize] = {};
+};
+
+class TreeStats {
+public:
+    static const bool enabled =
+#if defined(RBTREE_STATS)
+        true;
+#else
+        false;
+#endif
+
+    class Block {
+    public:
+        std::atomic<uint64_t> rotations;
+        std::atomic<uint64_t> insertFixups;
+        std::atomic<uint64_t> deleteFixups;
+        std::atomic<uint64_t> recolorings;
+        std::atomic<uint64_t> searchDepth[TreeStatsSnapshot::histogramSize];
+        std::atomic<uint64_t> heights[TreeStatsSnapshot::histogramSize];
+
+        Block();
+
+        // Вызывает только поток-владелец блока
+        void add(std::atomic<uint64_t> Block::*counter, uint64_t amount);
+        void record(std::atomic<uint64_t> (Block::*histogram)[TreeStatsSnapshot::histogramSize], size_t value);
+        void addTo(TreeStatsSnapshot& total) const;
+    };
+
+    // Блок текущего потока; регистрируется при первом обращении
+    static Block& local();
+    // Сумма по всем потокам, включая завершившиеся, с момента последнего reset()
+    static TreeStatsSnapshot snapshot();
+    // Запоминает текущие суммы как нулевую точку: блоки других потоков не трогаются
+    static void reset();
+
+private:
+    struct Registry {
+        std::mutex mutex;
+        std::vector<Block*> blocks;
+        // Счётчики завершившихся потоков
+        TreeStatsSnapshot retired;
+        TreeStatsSnapshot baseline;
+    };
+
+    // При завершении потока переносит его счётчики в retired
+    struct Owner {
+        Block block;
+        Owner();
+        ~Owner();
+    };
+
+    static Registry& registry();
+    static TreeStatsSnapshot total(Registry& registry);
+};
+
+inline TreeStats::Block::Block()
+{
+    rotations.store(0, std::memory_order_relaxed);
+    insertFixups.store(0, std::memory_order_relaxed);
+    deleteFixups.store(0, std::memory_order_relaxed);
+    recolorings.store(0, std::memory_order_relaxed);
+    for (size_t i = 0; i < TreeStatsSnapshot::histogramSize; i++) {
+        searchDepth[i].store(0, std::memory_order_relaxed);
+        heights[i].store(0, std::memory_order_relaxed);
+    }
+}
+
+// Блок пишет только его поток, поэтому атомарный fetch_add не нужен:
+// чтение и запись без упорядочивания компилируются в обычные mov
+inline void TreeStats::Block::add(std::atomic<uint64_t> Block::*counter, uint64_t amount)
+{
+    std::atomic<uint64_t>& value = this->*counter;
+    value.store(value.load(std::memory_order_relaxed) + amount, std::memory_order_relaxed);
+}
+
+inline void TreeStats::Block::record(std::atomic<uint64_t> (Block::*histogram)[TreeStatsSnapshot::histogramSize], size_t value)
+{
+    size_t index = value < TreeStatsSnapshot::histogramSize ? value : TreeStatsSnapshot::histogramSize - 1;
+    std::atomic<uint64_t>& cell = (this->*histogram)[index];
+    cell.store(cell.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+inline void TreeStats::Block::addTo(TreeStatsSnapshot& total) const
+{
+    total.rotations += rotations.load(std::memory_order_relaxed);
+    total.insertFixups += insertFixups.load(std::memory_order_relaxed);
+    total.deleteFixups += deleteFixups.load(std::memory_order_relaxed);
+    total.recolorings += recolorings.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < TreeStatsSnapshot::histogramSize; i++) {
+        total.searchDepth[i] += searchDepth[i].load(std::memory_order_relaxed);
+        total.heights[i] += heights[i].load(std::memory_order_relaxed);
+    }
+}
+
+inline TreeStats::Owner::Owner()
+{
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.blocks.push_back(&block);
+}
+
+inline TreeStats::Owner::~Owner()
+{
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    block.addTo(shared.retired);
+    for (size_t i = 0; i < shared.blocks.size(); i++) {
+        if (shared.blocks[i] == &block) {
+            shared.blocks[i] = shared.blocks.back();
+            shared.blocks.pop_back();
+            break;
+        }
+    }
+}
+
+// Реестр намеренно не разрушается: потоки общего пула ThreadPool завершаются
+// при разрушении статических объектов и в этот момент ещё сдают свои счётчики
+inline TreeStats::Registry& TreeStats::registry()
+{
+    static Registry* shared = new Registry;
+    return *shared;
+}
+
+inline TreeStats::Block& TreeStats::local()
+{
+    static thread_local Owner owner;
+    return owner.block;
+}
+
+inline TreeStatsSnapshot TreeStats::total(Registry& shared)
+{
+    TreeStatsSnapshot result = shared.retired;
+    for (const Block* block : shared.blocks) {
+        block->addTo(result);
+    }
+    return result;
+}
+
+inline TreeStatsSnapshot TreeStats::snapshot()
+{
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    TreeStatsSnapshot result = total(shared);
+    const TreeStatsSnapshot& zero = shared.baseline;
+    result.rotations -= zero.rotations;
+    result.insertFixups -= zero.insertFixups;
+    result.deleteFixups -= zero.deleteFixups;
+    result.recolorings -= zero.recolorings;
+    for (size_t i = 0; i < TreeStatsSnapshot::histogramSize; i++) {
+        result.searchDepth[i] -= zero.searchDepth[i];
+        result.heights[i] -= zero.heights[i];
+    }
+    return result;
+}
+
+inline void TreeStats::reset()
+{
+    Registry& shared = registry();
+    std::lock_guard<std::mutex> lock(shared.mutex);
+    shared.baseline = total(shared);
+}
+
+#endif // TREESTATS_H
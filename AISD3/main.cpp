@@ -1,14 +1,91 @@
-﻿#include <Windows.h>
+﻿#if defined(_WIN32)
+#define NOMINMAX
+#include <Windows.h>
+#else
+#include <limits.h>
+#include <unistd.h>
+#endif
 #include "Application.h"
+#include <cstdlib>
 
-int main()
+// Каталог исполняемого файла с разделителем на конце; пустая строка, если его не узнать
+static std::string executableDirectory(const char* argv0)
 {
-    SetConsoleCP(1251);
-    SetConsoleOutputCP(1251);
-    
-    Application app;
+    std::string path;
+#if defined(_WIN32)
+    char buffer[MAX_PATH];
+    DWORD length = GetModuleFileNameA(nullptr, buffer, MAX_PATH);
+    if (length > 0 && length < MAX_PATH) path.assign(buffer, length);
+#else
+    char buffer[PATH_MAX];
+    ssize_t length = readlink("/proc/self/exe", buffer, sizeof(buffer));
+    if (length > 0 && static_cast<size_t>(length) < sizeof(buffer)) path.assign(buffer, static_cast<size_t>(length));
+#endif
+    if (path.empty() && argv0) path = argv0;
+
+    size_t slash = path.find_last_of("/\\");
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+// AISD3 [--bracket-file путь] [--batch [сценарий]]
+//   --bracket-file — файл со скобочной записью для меню; без него берётся переменная
+//                    окружения AISD3_BRACKET_TREE, а без неё bracketTree.txt рядом с программой
+//   --batch        — пакетный режим без меню; без пути или с "-" сценарий читается из stdin
+int main(int argc, char* argv[])
+{
+#if defined(_WIN32)
+    // Строки программы собраны в UTF-8 (ключ /utf-8), консоль переводится на ту же кодировку
+    SetConsoleCP(CP_UTF8);
+    SetConsoleOutputCP(CP_UTF8);
+#endif
+
+    std::string pathToBracketTree;
+    const char* environmentPath = std::getenv("AISD3_BRACKET_TREE");
+    if (environmentPath && *environmentPath) {
+        pathToBracketTree = environmentPath;
+    }
+    else {
+        pathToBracketTree = executableDirectory(argc > 0 ? argv[0] : nullptr) + "bracketTree.txt";
+    }
+
+    bool batch = false;
+    std::string scriptPath = "-";
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        if (argument == "--bracket-file" && i + 1 < argc) {
+            pathToBracketTree = argv[++i];
+        }
+        else if (argument == "--batch") {
+            batch = true;
+            if (i + 1 < argc && std::string(argv[i + 1]).compare(0, 2, "--") != 0) {
+                scriptPath = argv[++i];
+            }
+        }
+        else {
+            std::cerr << "Неизвестный аргумент " << argument << '\n';
+            std::cerr << "Использование: AISD3 [--bracket-file путь] [--batch [сценарий]]\n";
+            return 1;
+        }
+    }
+
+    Application app(pathToBracketTree);
     BinaryTree<number> binaryTree;
     RedBlackTree<number> redBlackTree;
+
+    if (batch) {
+        std::ios::sync_with_stdio(false);
+        if (scriptPath == "-") {
+            return app.runBatch(std::cin, binaryTree, redBlackTree);
+        }
+
+        std::ifstream script(scriptPath);
+        if (!script) {
+            std::cerr << "Ошибка при открытии сценария " << scriptPath << '\n';
+            return 1;
+        }
+        return app.runBatch(script, binaryTree, redBlackTree);
+    }
+
     app.exec(binaryTree, redBlackTree);
 
     return 0;
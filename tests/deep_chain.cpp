@@ -0,0 +1,79 @@
+﻿// Вырожденное дерево-цепочка "(0 (1 (2 ...)))" глубиной в миллион узлов:
+// обходы BinaryTree не должны упираться в глубину стека и обязаны вернуть дерево
+// в исходный вид. Код возврата не ноль, если хоть одна проверка не прошла
+#include "BinaryTree.h"
+#include <cstdio>
+#include <string>
+#include <vector>
+
+static int failures = 0;
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { \
+            std::fprintf(stderr, "%s:%d: не выполнено %s\n", __FILE__, __LINE__, #condition); \
+            failures++; \
+        } \
+    } while (0)
+
+static std::string makeChain(size_t depth)
+{
+    std::string bracketTree;
+    bracketTree.reserve(depth * 4);
+    for (size_t i = 0; i < depth; i++) {
+        bracketTree += '(';
+        bracketTree += std::to_string(i % 10);
+        bracketTree += ' ';
+    }
+    bracketTree.append(depth, ')');
+    return bracketTree;
+}
+
+int main()
+{
+    const size_t depth = 1000000;
+    std::string bracketTree = makeChain(depth);
+
+    BinaryTree<double> tree;
+    CHECK(tree.build(bracketTree).ok());
+    CHECK(tree.getHeight() == static_cast<int>(depth));
+
+    std::vector<double> values = tree.postOrder();
+    CHECK(values.size() == depth);
+    // Post-order цепочки — узлы снизу вверх
+    CHECK(!values.empty() && values.front() == static_cast<double>((depth - 1) % 10) && values.back() == 0);
+
+    // Повторный обход видит то же дерево: предыдущие нити сняты
+    CHECK(tree.getHeight() == static_cast<int>(depth));
+    CHECK(tree.postOrder() == values);
+
+    // save идёт прямым обходом по Моররису
+    std::vector<char> buffer;
+    tree.save(buffer);
+    BinaryTree<double> loaded;
+    CHECK(loaded.load(buffer.data(), buffer.size()) == FormatError::None);
+    CHECK(loaded.getHeight() == static_cast<int>(depth));
+    CHECK(loaded.postOrder() == values);
+
+    // Вывод с ограничением глубины: строка на каждый из maxDepth + 1 верхних узлов
+    std::string text;
+    {
+        OutputBuffer out(text);
+        RenderOptions options;
+        options.maxDepth = 3;
+        CHECK(tree.render(out, options));
+    }
+    size_t lines = 0;
+    for (char symbol : text) lines += symbol == '\n';
+    CHECK(lines == 4);
+
+    tree.clear();
+    CHECK(tree.empty() && tree.getHeight() == 0);
+
+    if (failures) {
+        std::fprintf(stderr, "deep_chain: %d проверок не прошло\n", failures);
+        return 1;
+    }
+    std::printf("deep_chain: ok\n");
+    return 0;
+}
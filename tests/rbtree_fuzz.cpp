@@ -0,0 +1,372 @@
+﻿// Случайные операции над RedBlackTree сверяются с std::multiset<double>: после каждой
+// операции validate(), size(), search(), count() и inOrder() должны совпасть с моделью,
+// а поиск в дереве, пакетный поиск и снимок freeze() — друг с другом, в том числе для NaN.
+// Проверяются все три DuplicatePolicy, с OrderStatistics и без.
+// Запуск: rbtree_fuzz_test [seed] [операций]; код возврата не ноль при первом расхождении.
+// Отдельно join, split, unionWith, intersect и difference сверяются с моделью на деревьях
+// больше minParallelNodes, чтобы операции над множествами шли через fork в пуле потоков.
+// С AISD3_FUZZER (clang -fsanitize=fuzzer, опция AISD3_FUZZER в CMake) вместо main
+// собирается LLVMFuzzerTestOneInput, и поток операций берётся из входа libFuzzer
+#include "RedBlackTree.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <random>
+#include <set>
+#include <string>
+#include <vector>
+
+// Вход — поток решений: код операции, затем ключи. После конца входа — нули
+class ByteSource {
+public:
+    ByteSource(const uint8_t* data, size_t size) : data(data), size(size), position(0) {}
+
+    bool exhausted() const { return position >= size; }
+    uint8_t next() { return position < size ? data[position++] : 0; }
+    // Ключей немного, поэтому повторы и удаления существующих значений случаются часто
+    double key() { return (next() % 48) * 0.5; }
+
+private:
+    const uint8_t* data;
+    size_t size;
+    size_t position;
+};
+
+template <bool OrderStatistics, DuplicatePolicy Duplicates>
+class TreeFuzzer {
+public:
+    TreeFuzzer(const char* name) : name(name), step(0) {}
+
+    bool run(ByteSource& source);
+
+private:
+    typedef RedBlackTree<double, PoolAllocator, OrderStatistics, Duplicates> Tree;
+
+    const char* name;
+    size_t step;
+    Tree tree;
+    std::multiset<double> model;
+
+    bool fail(const char* what) const;
+    bool check(double key) const;
+    bool checkLookups() const;
+    static const std::vector<double>& probes();
+    bool admits(double key) const;
+    bool eraseOne(double key);
+    static std::vector<double> batch(ByteSource& source, size_t maxSize);
+};
+
+template <bool OrderStatistics, DuplicatePolicy Duplicates>
+bool TreeFuzzer<OrderStatistics, Duplicates>::fail(const char* what) const
+{
+    std::fprintf(stderr, "rbtree_fuzz: %s, операция %zu: %s\n", name, step, what);
+    return false;
+}
+
+// Reject не вставляет значение, которое уже есть
+template <bool OrderStatistics, DuplicatePolicy Duplicates>
+bool TreeFuzzer<OrderStatistics, Duplicates>::admits(double key) const
+{
+    return Duplicates != DuplicatePolicy::Reject || model.find(key) == model.end();
+}
+
+template <bool OrderStatistics, DuplicatePolicy Duplicates>
+bool TreeFuzzer<OrderStatistics, Duplicates>::eraseOne(double key)
+{
+    std::multiset<double>::iterator found = model.find(key);
+    if (found == model.end()) return false;
+    model.erase(found);
+    return true;
+}
+
+template <bool OrderStatistics, DuplicatePolicy Duplicates>
+std::vector<double> TreeFuzzer<OrderStatistics, Duplicates>::batch(ByteSource& source, size_t maxSize)
+{
+    std::vector<double> keys(source.next() % (maxSize + 1));
+    for (double& key : keys) {
+        key = source.key();
+    }
+    return keys;
+}
+
+// Все ключи, которые может выдать ByteSource, и ключи вне их диапазона: меньше минимума,
+// больше максимума, бесконечности и NaN. Их больше 16, поэтому containsBatch
+// проходит и векторным путём, и скалярным хвостом
+template <bool OrderStatistics, DuplicatePolicy Duplicates>
+const std::vector<double>& TreeFuzzer<OrderStatistics, Duplicates>::probes()
+{
+    static const std::vector<double> keys = [] {
+        std::vector<double> result = { -1, 0.25, 23.75, 100, std::numeric_limits<double>::quiet_NaN(),
+                                       -std::numeric_limits<double>::infinity(), std::numeric_limits<double>::infinity() };
+        for (int i = 0; i < 48; i++) {
+            result.push_back(i * 0.5);
+        }
+        // Хвост за последней полной группой из 16 ищется скалярно
+        result.push_back(std::numeric_limits<double>::quiet_NaN());
+        result.push_back(-1);
+        return result;
+    }();
+    return keys;
+}
+
+// search, searchBatch и снимок freeze() должны отвечать одинаково и так же, как модель
+template <bool OrderStatistics, DuplicatePolicy Duplicates>
+bool TreeFuzzer<OrderStatistics, Duplicates>::checkLookups() const
+{
+    const std::vector<double>& keys = probes();
+    std::unique_ptr<bool[]> batchFound(new bool[keys.size()]);
+    std::unique_ptr<bool[]> frozenFound(new bool[keys.size()]);
+    tree.searchBatch(keys.data(), keys.size(), batchFound.get());
+    FrozenTree<double> frozen = tree.freeze();
+    frozen.containsBatch(keys.data(), keys.size(), frozenFound.get());
+
+    for (size_t i = 0; i < keys.size(); i++) {
+        // std::multiset считает NaN эквивалентным любому значению, поэтому find дополняется равенством
+        std::multiset<double>::const_iterator found = model.find(keys[i]);
+        bool expected = found != model.end() && *found == keys[i];
+        if ((tree.search(keys[i]) != nullptr) != expected) return fail("search() не совпал с моделью");
+        if (batchFound[i] != expected) return fail("searchBatch() не совпал с моделью");
+        if (frozen.contains(keys[i]) != expected) return fail("FrozenTree::contains() не совпал с моделью");
+        if (frozenFound[i] != expected) return fail("FrozenTree::containsBatch() не совпал с моделью");
+    }
+    return true;
+}
+
+template <bool OrderStatistics, DuplicatePolicy Duplicates>
+bool TreeFuzzer<OrderStatistics, Duplicates>::check(double key) const
+{
+    if (tree.validate() != TreeViolation::None) return fail("validate() нашёл нарушение");
+    if (tree.size() != model.size() || tree.empty() != model.empty()) return fail("size() не совпал с моделью");
+    if ((tree.search(key) != nullptr) != (model.find(key) != model.end())) return fail("search() не совпал с моделью");
+    if (tree.count(key) != model.count(key)) return fail("count() не совпал с моделью");
+
+    std::vector<double> values = tree.inOrder();
+    if (values.size() != model.size() || !std::equal(values.begin(), values.end(), model.begin())) {
+        return fail("inOrder() не совпал с моделью");
+    }
+    if (!checkLookups()) return false;
+
+    if constexpr (OrderStatistics) {
+        size_t below = static_cast<size_t>(std::distance(model.begin(), model.lower_bound(key)));
+        if (tree.rank(key) != below) return fail("rank() не совпал с моделью");
+        if (tree.countInRange(key, key + 4) != static_cast<size_t>(std::distance(model.lower_bound(key), model.upper_bound(key + 4)))) {
+            return fail("countInRange() не совпал с моделью");
+        }
+        if (!model.empty()) {
+            size_t index = below < model.size() ? below : model.size() - 1;
+            auto selected = tree.select(index);
+            if (!selected || selected->value != values[index]) return fail("select() не совпал с моделью");
+        }
+    }
+    return true;
+}
+
+template <bool OrderStatistics, DuplicatePolicy Duplicates>
+bool TreeFuzzer<OrderStatistics, Duplicates>::run(ByteSource& source)
+{
+    while (!source.exhausted()) {
+        step++;
+        uint8_t operation = source.next();
+        double key = source.key();
+
+        switch (operation % 16) {
+        case 12: {
+            std::vector<double> keys = batch(source, 8);
+            keys.push_back(key);
+            for (double value : keys) {
+                if (admits(value)) model.insert(value);
+            }
+            tree.insertBatch(keys);
+            break;
+        }
+        case 13: {
+            std::vector<double> keys = batch(source, 8);
+            keys.push_back(key);
+            size_t erased = 0;
+            for (double value : keys) {
+                erased += eraseOne(value);
+            }
+            if (tree.eraseBatch(keys) != erased) return fail("eraseBatch() удалил не столько значений");
+            break;
+        }
+        case 14: {
+            std::vector<double> keys = batch(source, 32);
+            model.clear();
+            for (double value : keys) {
+                if (admits(value)) model.insert(value);
+            }
+            tree.bulkLoad(keys);
+            break;
+        }
+        case 15:
+            // Очистка редка, иначе дерево не успевает вырасти
+            if (operation < 16) {
+                model.clear();
+                tree.clear();
+                break;
+            }
+            [[fallthrough]];
+        case 7: case 8: case 9: case 10: case 11: {
+            bool expected = eraseOne(key);
+            if (tree.deleteNode(key) != expected) return fail("deleteNode() вернул не то");
+            break;
+        }
+        default: {
+            bool expected = admits(key);
+            if (expected) model.insert(key);
+            if (tree.insert(key) != expected) return fail("insert() вернул не то");
+            break;
+        }
+        }
+
+        if (!check(key)) return false;
+    }
+    return true;
+}
+
+static bool fuzzAll(const uint8_t* data, size_t size)
+{
+    bool ok = true;
+    {
+        ByteSource source(data, size);
+        ok = TreeFuzzer<false, DuplicatePolicy::Multiset>("Multiset").run(source) && ok;
+    }
+    {
+        ByteSource source(data, size);
+        ok = TreeFuzzer<false, DuplicatePolicy::Reject>("Reject").run(source) && ok;
+    }
+    {
+        ByteSource source(data, size);
+        ok = TreeFuzzer<false, DuplicatePolicy::Counted>("Counted").run(source) && ok;
+    }
+    {
+        ByteSource source(data, size);
+        ok = TreeFuzzer<true, DuplicatePolicy::Multiset>("Multiset + OrderStatistics").run(source) && ok;
+    }
+    {
+        ByteSource source(data, size);
+        ok = TreeFuzzer<true, DuplicatePolicy::Reject>("Reject + OrderStatistics").run(source) && ok;
+    }
+    {
+        ByteSource source(data, size);
+        ok = TreeFuzzer<true, DuplicatePolicy::Counted>("Counted + OrderStatistics").run(source) && ok;
+    }
+    return ok;
+}
+
+// Случайные ключи с повторами; в двух наборах много общих значений
+static std::vector<double> randomKeys(std::mt19937_64& generator, size_t count)
+{
+    std::vector<double> keys(count);
+    for (double& key : keys) {
+        key = static_cast<double>(generator() % 60000) * 0.5;
+    }
+    return keys;
+}
+
+template <typename Tree>
+static bool matches(const Tree& tree, const std::multiset<double>& model, const char* name, const char* operation)
+{
+    std::vector<double> values = tree.inOrder();
+    if (tree.validate() == TreeViolation::None && tree.size() == model.size() && values.size() == model.size() &&
+        std::equal(values.begin(), values.end(), model.begin())) {
+        return true;
+    }
+    std::fprintf(stderr, "rbtree_fuzz: %s, %s: дерево не совпало с моделью\n", name, operation);
+    return false;
+}
+
+// Операции над множествами есть только у Multiset. Деревья в 50 и 40 тысяч значений
+// больше minParallelNodes, а в пуле четыре потока, поэтому forkDepth не ноль
+template <bool OrderStatistics>
+static bool fuzzSetOperations(unsigned long long seed, const char* name)
+{
+    typedef RedBlackTree<double, PoolAllocator, OrderStatistics> Tree;
+
+    ThreadPool pool(4);
+    std::mt19937_64 generator(seed);
+    std::vector<double> aKeys = randomKeys(generator, 50000);
+    std::vector<double> bKeys = randomKeys(generator, 40000);
+    std::multiset<double> bModel(bKeys.begin(), bKeys.end());
+    std::set<double> bValues(bKeys.begin(), bKeys.end());
+
+    // Первое дерево собирается вставками, второе — bulkLoad: формы деревьев разные
+    Tree a, b;
+    std::multiset<double> model(aKeys.begin(), aKeys.end());
+    a.insertBatch(aKeys);
+    b.bulkLoad(bKeys);
+    a.unionWith(b, pool);
+    model.insert(bKeys.begin(), bKeys.end());
+    if (!matches(a, model, name, "unionWith") || !b.empty()) return false;
+
+    Tree c, d;
+    c.insertBatch(aKeys);
+    d.bulkLoad(bKeys);
+    c.intersect(d, pool);
+    model.clear();
+    for (double key : aKeys) {
+        if (bValues.count(key)) model.insert(key);
+    }
+    if (!matches(c, model, name, "intersect") || !matches(d, bModel, name, "intersect, второе дерево")) return false;
+
+    Tree e;
+    e.insertBatch(aKeys);
+    e.difference(d, pool);
+    model.clear();
+    for (double key : aKeys) {
+        if (!bValues.count(key)) model.insert(key);
+    }
+    if (!matches(e, model, name, "difference")) return false;
+
+    Tree f, right;
+    f.insertBatch(aKeys);
+    double key = aKeys[generator() % aKeys.size()];
+    f.split(key, right);
+    std::multiset<double> all(aKeys.begin(), aKeys.end());
+    std::multiset<double> less(all.begin(), all.lower_bound(key));
+    std::multiset<double> notLess(all.lower_bound(key), all.end());
+    if (!matches(f, less, name, "split, левая часть") || !matches(right, notLess, name, "split, правая часть")) return false;
+
+    f.join(right);
+    if (!matches(f, all, name, "join") || !right.empty()) return false;
+
+    // Перекрывающиеся значения: join сводится к объединению
+    f.join(d);
+    all.insert(bKeys.begin(), bKeys.end());
+    return matches(f, all, name, "join с перекрытием") && d.empty();
+}
+
+#if defined(AISD3_FUZZER)
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    if (!fuzzAll(data, size)) std::abort();
+    return 0;
+}
+#else
+int main(int argc, char* argv[])
+{
+    unsigned long long seed = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : 1;
+    size_t operations = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : 20000;
+
+    // В среднем операция занимает меньше четырёх байт
+    std::vector<uint8_t> bytes(operations * 4);
+    std::mt19937_64 generator(seed);
+    for (uint8_t& byte : bytes) {
+        byte = static_cast<uint8_t>(generator());
+    }
+
+    bool ok = fuzzAll(bytes.data(), bytes.size());
+    ok = fuzzSetOperations<false>(seed, "операции над множествами") && ok;
+    ok = fuzzSetOperations<true>(seed, "операции над множествами + OrderStatistics") && ok;
+    if (!ok) {
+        std::fprintf(stderr, "rbtree_fuzz: seed %llu\n", seed);
+        return 1;
+    }
+    std::printf("rbtree_fuzz: ok (seed %llu)\n", seed);
+    return 0;
+}
+#endif
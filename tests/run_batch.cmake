@@ -0,0 +1,11 @@
+# Запускает AISD3 --batch на сценарии и сравнивает stdout с ожидаемым выводом.
+# cmake -DAPP=путь -DSCRIPT=сценарий -DEXPECTED=файл -P run_batch.cmake
+execute_process(COMMAND ${APP} --batch ${SCRIPT} OUTPUT_VARIABLE output RESULT_VARIABLE result)
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "AISD3 --batch завершился с кодом ${result}")
+endif()
+
+file(READ ${EXPECTED} expected)
+if(NOT output STREQUAL expected)
+    message(FATAL_ERROR "Вывод отличается от ${EXPECTED}:\n${output}")
+endif()